@@ -1,6 +1,105 @@
 #include "amf.h"
 
 #include <string.h>
+#include <stddef.h>
+#include <math.h>
+
+
+/* arena allocator */
+void
+amf_arena_init(amf_arena_t * arena, size_t block_size)
+{
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->block_size = (block_size > 0) ? block_size : AMF_ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+
+static amf_arena_block_t *
+amf_arena_block_new(size_t size)
+{
+    amf_arena_block_t * block = (amf_arena_block_t*) malloc(sizeof(amf_arena_block_t) + size);
+    if (block != NULL) {
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+    }
+    return block;
+}
+
+
+void *
+amf_arena_alloc(amf_arena_t * arena, size_t size)
+{
+    amf_arena_block_t * block = arena->current;
+    void * p;
+
+    size = (size + AMF_ARENA_ALIGN - 1) & ~((size_t) AMF_ARENA_ALIGN - 1);
+
+    /* move to the next block kept by a reset, or chain a new one */
+    while (block == NULL || block->used + size > block->size) {
+        if (block != NULL && block->next != NULL) {
+            block = block->next;
+            continue;
+        }
+        amf_arena_block_t * next = amf_arena_block_new((size > arena->block_size) ? size : arena->block_size);
+        if (next == NULL) {
+            return NULL;
+        }
+        if (block != NULL) {
+            block->next = next;
+        } else {
+            arena->first = next;
+        }
+        block = next;
+    }
+    arena->current = block;
+
+    p = (u_byte*) (block + 1) + block->used;
+    block->used += size;
+    return p;
+}
+
+
+/* release every allocation at once, blocks are kept for reuse */
+void
+amf_arena_reset(amf_arena_t * arena)
+{
+    amf_arena_block_t * block;
+    for (block = arena->first; block != NULL; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+}
+
+
+void
+amf_arena_free(amf_arena_t * arena)
+{
+    amf_arena_block_t * block = arena->first;
+    amf_arena_block_t * next;
+    while (block != NULL) {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = arena->current = NULL;
+}
+
+
+
+/* key index of objects */
+typedef struct amf_hash_slot_s {
+    u_int           hash;
+    u_int           index;          // index of the name node, 0 if free
+} amf_hash_slot_t;
+
+typedef struct amf_hash_s {
+    u_int           mask;           // slots - 1, slots is a power of two
+    u_int           count;
+    u_byte          arena;          // allocated from an arena, never freed
+    amf_hash_slot_t slots[];
+} amf_hash_t;
 
 
 /* function common to all array types */
@@ -9,80 +108,174 @@ amf_list_init(amf_list_t * list)
 {
     if (list != NULL) {
         list->size = 0;
-        list->first_element = NULL;
-        list->last_element = NULL;
+        list->capacity = 0;
+        list->nodes = NULL;
+        list->hash = NULL;
+        list->encoded = 0;
+        list->parent = NULL;
     }
 }
 
 
-static amf_data_t * 
-amf_list_push(amf_list_t * list, amf_data_t * data) 
+/* the container embedding a list */
+#define amf_list_owner(list) \
+    ((amf_data_t*) ((byte*) (list) - offsetof(amf_data_t, list_data)))
+
+#define amf_data_is_container(d) \
+    ((d)->type == AMF_TYPE_OBJECT || (d)->type == AMF_TYPE_ASSOCIATIVE_ARRAY || (d)->type == AMF_TYPE_ARRAY)
+
+/* shared values and the values inside them are read-only */
+#define amf_data_writable(d) \
+    ((d) != NULL && amf_data_refs(d) == 0 && !((d)->flags & AMF_DATA_FLAG_FROZEN))
+
+/* arena containers can't grow nor hold heap elements, their scalars are set in place */
+#define amf_data_resizable(d) \
+    (amf_data_writable(d) && !((d)->flags & AMF_DATA_FLAG_ARENA))
+
+#if defined(__GNUC__)
+#define amf_refs_increment(d)       __atomic_fetch_add(&(d)->refs, 1, __ATOMIC_RELAXED)
+/* from old to old - 1, false when another owner changed the count first (old is reloaded) */
+#define amf_refs_decrement(d, old) \
+    __atomic_compare_exchange_n(&(d)->refs, &(old), (old) - 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+#define amf_refs_increment(d)       (++((d)->refs))
+#define amf_refs_decrement(d, old)  ((d)->refs = (old) - 1, 1)
+#endif
+
+
+/* encoded size of a container holding the given elements, keys are written without marker */
+static size_t 
+amf_container_size(byte type, size_t encoded, u_int size)
 {
-    amf_node_t * node = (amf_node_t*) malloc(sizeof(amf_node_t));
-    if (node != NULL) {
-        node->data = data;
-        node->next = NULL;
-        node->prev = NULL;
-        if (list->size == 0) {
-            list->first_element = node;
-            list->last_element = node;
-        } else {
-            list->last_element->next = node;
-            node->prev = list->last_element;
-            list->last_element = node;
-        }
-        ++(list->size);
-        return data;
+    switch (type) {
+        case AMF_TYPE_OBJECT:
+            return sizeof(byte) + encoded - size / 2 + sizeof(u_short) + sizeof(u_byte);
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+            return sizeof(byte) + sizeof(u_int) + encoded - size / 2 + sizeof(u_short) + sizeof(u_byte);
+        default:
+            return sizeof(byte) + sizeof(u_int) + encoded;
     }
-    return NULL;
 }
 
 
-static amf_data_t * 
-amf_list_insertfore(amf_list_t * list, amf_node_t * node, amf_data_t * data) 
+/*
+ * Encoded sizes: an element has just joined or left a list that held count elements
+ * before, the list and the containers above it follow. Elements other than containers
+ * never change size once created.
+ */
+static void 
+amf_list_account(amf_list_t * list, amf_data_t * element, int joined, u_int count)
 {
-    if (node != NULL) {
-        amf_node_t * new_node = (amf_node_t*) malloc(sizeof(amf_node_t));
-        if (new_node != NULL) {
-            new_node->next = node;
-            new_node->prev = node->prev;
-
-            if (node->prev != NULL) {
-                node->prev->next = new_node;
-                node->prev = new_node;
-            } else {
-                list->first_element = new_node;
-            }
-            ++(list->size);
-            new_node->data = data;
-            return data;
+    amf_data_t * owner = amf_list_owner(list);
+    size_t before = amf_container_size(owner->type, list->encoded, count);
+    size_t delta;
+    amf_data_t * parent;
+
+    if (joined) {
+        list->encoded += amf_data_size(element);
+    } else {
+        list->encoded -= amf_data_size(element);
+    }
+    if (amf_data_is_container(element)) {
+        element->list_data.parent = joined ? owner : NULL;
+    }
+
+    /* modular arithmetic: adding the delta also works when the size shrinks */
+    delta = amf_container_size(owner->type, list->encoded, list->size) - before;
+    for (parent = list->parent; parent != NULL; parent = parent->list_data.parent) {
+        parent->list_data.encoded += delta;
+    }
+}
+
+
+static void 
+amf_list_drop_hash(amf_list_t * list)
+{
+    if (list->hash != NULL && !list->hash->arena) {
+        free(list->hash);
+    }
+    list->hash = NULL;
+}
+
+
+/* make room for n elements, the nodes move when they are reallocated */
+static int 
+amf_list_reserve(amf_list_t * list, u_int n, amf_arena_t * arena)
+{
+    amf_node_t * nodes;
+    u_int capacity;
+
+    if (n <= list->capacity) {
+        return 1;
+    }
+    capacity = (list->capacity > 0) ? list->capacity * 2 : AMF_LIST_MIN_CAPACITY;
+    if (capacity < n) {
+        capacity = n;
+    }
+
+    /* two more slots for the sentinels */
+    if (arena != NULL) {
+        nodes = (amf_node_t*) amf_arena_alloc(arena, (capacity + 2) * sizeof(amf_node_t));
+        if (nodes != NULL && list->nodes != NULL) {
+            memcpy(nodes, list->nodes, (list->size + 2) * sizeof(amf_node_t));
         }
+    } else {
+        nodes = (amf_node_t*) realloc(list->nodes, (capacity + 2) * sizeof(amf_node_t));
     }
-    return NULL;
+    if (nodes == NULL) {
+        return 0;
+    }
+    if (list->nodes == NULL) {
+        nodes[0].data = NULL;
+        nodes[1].data = NULL;
+    }
+    list->nodes = nodes;
+    list->capacity = capacity;
+    return 1;
 }
 
 
+/* insert data at index i, 0 <= i <= size */
 static amf_data_t * 
-amf_list_insert_after(amf_list_t * list, amf_node_t * node, amf_data_t * data)
+amf_list_insert_at(amf_list_t * list, u_int i, amf_data_t * data, amf_arena_t * arena)
 {
-    if (node != NULL) {
-        amf_node_t * new_node = (amf_node_t*) malloc(sizeof(amf_node_t));
-        if (new_node != NULL) {
-            new_node->next = node->next;
-            new_node->prev = node;
-
-            if (node->next != NULL) {
-                node->next->prev = new_node;
-                node->next = new_node;
-            } else {
-                list->last_element = new_node;
-            }
-            ++(list->size);
-            new_node->data = data;
-            return data;
-        }
+    if (data == NULL || i > list->size || !amf_list_reserve(list, list->size + 1, arena)) {
+        return NULL;
     }
-    return NULL;
+    amf_list_drop_hash(list);
+    memmove(&list->nodes[i + 2], &list->nodes[i + 1], (list->size - i + 1) * sizeof(amf_node_t));
+    list->nodes[i + 1].data = data;
+    ++(list->size);
+    amf_list_account(list, data, 1, list->size - 1);
+    return data;
+}
+
+
+static amf_data_t * 
+amf_list_push_arena(amf_list_t * list, amf_data_t * data, amf_arena_t * arena) {
+    return amf_list_insert_at(list, list->size, data, arena);
+}
+
+
+static amf_data_t * 
+amf_list_push(amf_list_t * list, amf_data_t * data) {
+    return amf_list_insert_at(list, list->size, data, NULL);
+}
+
+
+/* index of a node of the list */
+#define amf_list_index(list, node)  ((u_int) ((node) - (list)->nodes) - 1)
+
+
+static amf_data_t * 
+amf_list_insertfore(amf_list_t * list, amf_node_t * node, amf_data_t * data) {
+    return (node != NULL) ? amf_list_insert_at(list, amf_list_index(list, node), data, NULL) : NULL;
+}
+
+
+static amf_data_t * 
+amf_list_insert_after(amf_list_t * list, amf_node_t * node, amf_data_t * data) {
+    return (node != NULL) ? amf_list_insert_at(list, amf_list_index(list, node) + 1, data, NULL) : NULL;
 }
 
 
@@ -91,111 +284,445 @@ amf_list_delete(amf_list_t * list, amf_node_t * node)
 {
     amf_data_t * data = NULL;
     if (node != NULL) {
-        if (node->next != NULL) {
-            node->next->prev = node->prev;
-        }
-        if (node->prev != NULL) {
-            node->prev->next = node->next;
-        }
-        if (node == list->first_element) {
-            list->first_element = node->next;
-        }
-        if (node == list->last_element) {
-            list->last_element = node->prev;
-        }
+        amf_list_drop_hash(list);
         data = node->data;
-        free(node);
+        /* shift the tail and the end sentinel down */
+        memmove(node, node + 1, (size_t) (&list->nodes[list->size + 1] - node) * sizeof(amf_node_t));
         --(list->size);
+        amf_list_account(list, data, 0, list->size + 1);
     }
     return data;
 }
 
 
 static amf_data_t * 
-amf_list_get_at(const amf_list_t * list, u_int n) 
+amf_list_get_at(const amf_list_t * list, u_int n) {
+    return (n < list->size) ? list->nodes[n + 1].data : NULL;
+}
+
+
+static amf_node_t * 
+amf_list_first(const amf_list_t * list) {
+    return (list->size > 0) ? &list->nodes[1] : NULL;
+}
+
+
+static amf_node_t * 
+amf_list_last(const amf_list_t * list) {
+    return (list->size > 0) ? &list->nodes[list->size] : NULL;
+}
+
+
+static amf_data_t * 
+amf_list_pop(amf_list_t * list) {
+    return amf_list_delete(list, amf_list_last(list));
+}
+
+
+static void 
+amf_list_clear(amf_list_t * list)
 {
-    if (n < list->size) {
-        u_int i;
-        amf_node_t * node = list->first_element;
-        for (i = 0; i < n; ++i) {
-            node = node->next;
+    u_int i;
+    for (i = 1; i <= list->size; ++i) {
+        amf_data_free(list->nodes[i].data);
+    }
+    free(list->nodes);
+    amf_list_drop_hash(list);
+    amf_list_init(list);
+}
+
+
+/* key index */
+static u_int 
+amf_hash_key(const byte * key, size_t size)
+{
+    /* FNV-1a */
+    u_int h = 2166136261u;
+    size_t i;
+    for (i = 0; i < size; ++i) {
+        h = (h ^ (u_byte) key[i]) * 16777619u;
+    }
+    return h;
+}
+
+
+/* exact comparison of a name with a key of the given size */
+#define amf_key_equals(name, key, size) \
+    ((name)->string_data.size == (size) && memcmp((name)->string_data.mbstr, (key), (size)) == 0)
+
+
+/* interned key, the string data comes first */
+typedef struct amf_intern_key_s {
+    amf_data_t      data;
+    u_int           hash;
+    amf_intern_t   *table;
+    byte            bytes[];        // NUL terminated
+} amf_intern_key_t;
+
+#define amf_intern_key(d)       ((const amf_intern_key_t*) (d))
+
+/* hash of a name, computed once for interned ones */
+#define amf_name_hash(name) \
+    (((name)->flags & AMF_DATA_FLAG_INTERNED) ? amf_intern_key(name)->hash \
+        : amf_hash_key((name)->string_data.mbstr, (name)->string_data.size))
+
+
+/* a name against a key, given as a string when there is one: same table keys are compared by pointer */
+static int 
+amf_name_equals(const amf_data_t * name, const amf_data_t * key, const byte * bytes, size_t size)
+{
+    if (name == key) {
+        return 1;
+    }
+    if (key != NULL
+    &&  (name->flags & key->flags & AMF_DATA_FLAG_INTERNED)
+    &&  amf_intern_key(name)->table == amf_intern_key(key)->table)
+    {
+        return 0;
+    }
+    return amf_key_equals(name, bytes, size);
+}
+
+
+/* slot of a key, either holding it or the free one where it goes */
+static amf_hash_slot_t * 
+amf_hash_find(const amf_list_t * list, const amf_data_t * key, const byte * bytes, size_t size, u_int h)
+{
+    amf_hash_t * hash = list->hash;
+    u_int i = h & hash->mask;
+    while (hash->slots[i].index != 0) {
+        if (hash->slots[i].hash == h
+        &&  amf_name_equals(list->nodes[hash->slots[i].index].data, key, bytes, size))
+        {
+            break;
         }
-        return node->data;
+        i = (i + 1) & hash->mask;
     }
-    return NULL;
+    return &hash->slots[i];
 }
 
 
-static amf_data_t * 
-amf_list_pop(amf_list_t * list) {
-    return amf_list_delete(list, list->last_element);
+/* index the name node at position i (1 based), the table is at most half full */
+static void 
+amf_hash_insert(amf_list_t * list, u_int i)
+{
+    amf_data_t * name = list->nodes[i].data;
+    u_int h = amf_name_hash(name);
+    amf_hash_slot_t * slot = amf_hash_find(list, name, name->string_data.mbstr, name->string_data.size, h);
+    if (slot->index == 0) {
+        slot->hash = h;
+        slot->index = i;
+        ++(list->hash->count);
+    }
+}
+
+
+static int 
+amf_hash_build(amf_list_t * list, amf_arena_t * arena)
+{
+    u_int pairs = list->size / 2;
+    u_int slots = 16;
+    size_t size;
+    u_int i;
+
+    while (slots < pairs * 2) {
+        slots *= 2;
+    }
+    size = sizeof(amf_hash_t) + slots * sizeof(amf_hash_slot_t);
+
+    amf_list_drop_hash(list);
+    list->hash = (amf_hash_t*) ((arena != NULL) ? amf_arena_alloc(arena, size) : malloc(size));
+    if (list->hash == NULL) {
+        return 0;
+    }
+    memset(list->hash, 0, size);
+    list->hash->mask = slots - 1;
+    list->hash->arena = (arena != NULL);
+
+    for (i = 1; i < list->size; i += 2) {
+        amf_hash_insert(list, i);
+    }
+    return 1;
 }
 
 
+/* index the keys of an object holding enough pairs, lookups scan them otherwise */
+static void 
+amf_object_index(amf_data_t * data, amf_arena_t * arena)
+{
+    if (data != NULL
+    &&  (data->type == AMF_TYPE_OBJECT || data->type == AMF_TYPE_ASSOCIATIVE_ARRAY)
+    &&  data->list_data.hash == NULL && data->list_data.size / 2 >= AMF_HASH_MIN_PAIRS)
+    {
+        amf_hash_build(&data->list_data, arena);
+    }
+}
+
+
+/* name node of a key, NULL if absent */
 static amf_node_t * 
-amf_list_first(const amf_list_t * list) {
-    return list->first_element;
+amf_object_find_key(const amf_data_t * data, const amf_data_t * key, const byte * bytes, size_t size, u_int h)
+{
+    const amf_list_t * list = &data->list_data;
+    amf_node_t * node;
+    amf_hash_slot_t * slot;
+
+    if (list->hash != NULL) {
+        slot = amf_hash_find(list, key, bytes, size, h);
+        return (slot->index != 0) ? &list->nodes[slot->index] : NULL;
+    }
+
+    for (node = amf_list_first(list); node != NULL; node = amf_object_next(node)) {
+        if (amf_name_equals(node->data, key, bytes, size)) {
+            return node;
+        }
+    }
+    return NULL;
 }
 
 
 static amf_node_t * 
-amf_list_last(const amf_list_t * list) {
-    return list->last_element;
+amf_object_find(const amf_data_t * data, const char * name)
+{
+    size_t size = strlen(name);
+    return amf_object_find_key(data, NULL, (const byte*) name, size, amf_hash_key((const byte*) name, size));
 }
 
 
-static void 
-amf_list_clear(amf_list_t * list)
+/* intern table */
+void 
+amf_intern_init(amf_intern_t * intern)
 {
-    amf_node_t * tmp;
-    amf_node_t * node = list->first_element;
-    while (node != NULL) {
-        amf_data_free(node->data);
-        tmp = node;
-        node = node->next;
-        free(tmp);
+    intern->count = 0;
+    intern->mask = 0;
+    intern->slots = NULL;
+}
+
+
+void 
+amf_intern_free(amf_intern_t * intern)
+{
+    u_int i;
+    if (intern->slots != NULL) {
+        for (i = 0; i <= intern->mask; ++i) {
+            free(intern->slots[i]);
+        }
+        free(intern->slots);
+    }
+    amf_intern_init(intern);
+}
+
+
+/* double the slots, the table is kept at most half full */
+static int 
+amf_intern_grow(amf_intern_t * intern)
+{
+    u_int slots = (intern->slots != NULL) ? (intern->mask + 1) * 2 : 64;
+    amf_intern_key_t ** table = (amf_intern_key_t**) calloc(slots, sizeof(amf_intern_key_t*));
+    u_int i, j;
+
+    if (table == NULL) {
+        return 0;
+    }
+    if (intern->slots != NULL) {
+        for (i = 0; i <= intern->mask; ++i) {
+            if (intern->slots[i] != NULL) {
+                j = intern->slots[i]->hash & (slots - 1);
+                while (table[j] != NULL) {
+                    j = (j + 1) & (slots - 1);
+                }
+                table[j] = intern->slots[i];
+            }
+        }
+        free(intern->slots);
+    }
+    intern->slots = table;
+    intern->mask = slots - 1;
+    return 1;
+}
+
+
+amf_data_t * 
+amf_intern(amf_intern_t * intern, const byte * key, u_short size)
+{
+    u_int h = amf_hash_key(key, size);
+    amf_intern_key_t * entry;
+    u_int i;
+
+    if (intern->slots != NULL) {
+        for (i = h & intern->mask; (entry = intern->slots[i]) != NULL; i = (i + 1) & intern->mask) {
+            if (entry->hash == h && amf_key_equals(&entry->data, key, size)) {
+                return &entry->data;
+            }
+        }
+    }
+
+    if (size > AMF_INTERN_MAX_SIZE || intern->count >= AMF_INTERN_MAX_KEYS) {
+        return NULL;
     }
-    list->size = 0;
+    if ((intern->count + 1) * 2 > intern->mask + 1 && !amf_intern_grow(intern)) {
+        return NULL;
+    }
+
+    entry = (amf_intern_key_t*) malloc(sizeof(amf_intern_key_t) + (size_t) size + 1);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->data.type = AMF_TYPE_STRING;
+    entry->data.error_code = AMF_ERROR_OK;
+    entry->data.flags = AMF_DATA_FLAG_INTERNED;
+    entry->data.refs = 0;
+    entry->data.string_data.size = size;
+    entry->data.string_data.mbstr = entry->bytes;
+    entry->hash = h;
+    entry->table = intern;
+    memcpy(entry->bytes, key, size);
+    entry->bytes[size] = '\0';
+
+    i = h & intern->mask;
+    while (intern->slots[i] != NULL) {
+        i = (i + 1) & intern->mask;
+    }
+    intern->slots[i] = entry;
+    ++(intern->count);
+    return &entry->data;
 }
 
 
 static amf_list_t * 
 amf_list_clone(const amf_list_t * list, amf_list_t * out_list)
 {
-    amf_node_t * node;
-    node = list->first_element;
-    while (node != NULL) {
-        amf_list_push(out_list, amf_data_clone(node->data));
-        node = node->next;
+    u_int i;
+    if (amf_list_reserve(out_list, list->size, NULL)) {
+        for (i = 1; i <= list->size; ++i) {
+            amf_list_push(out_list, amf_data_clone(list->nodes[i].data));
+        }
+    }
+    return out_list;
+}
+
+
+/* structure used to mimic a stream with a memory buffer */
+typedef struct __buffer_context {
+    byte * start_address;
+    byte * current_address;
+    size_t buffer_size;
+} buffer_context;
+
+
+/* decoder state shared by the readers */
+typedef struct amf_reader_s {
+    /* stream source */
+    amf_read_proc   read_proc;
+    void           *user_data;
+    /* buffer source, read in place when direct is set */
+    u_byte          direct;
+    const u_byte   *pos;
+    const u_byte   *end;
+
+    amf_arena_t    *arena;          // NULL for heap allocations
+    u_byte          borrow;         // strings point into the buffer
+    amf_intern_t   *intern;         // object keys are interned when set
+
+    const amf_limits_t *limits;     // NULL when unlimited
+    u_int           elements;       // values decoded
+    size_t          bytes;          // memory charged against limits->max_bytes
+    u_byte          scratch[8];     // fixed size fields read from a stream
+} amf_reader_t;
+
+
+static void 
+amf_reader_init_stream(amf_reader_t * reader, amf_read_proc read_proc, void * user_data, amf_arena_t * arena)
+{
+    memset(reader, 0, sizeof(amf_reader_t));
+    reader->read_proc = read_proc;
+    reader->user_data = user_data;
+    reader->arena = arena;
+}
+
+
+/* buffers are decoded in place, without going through buffer_read() */
+static void 
+amf_reader_init_buffer(amf_reader_t * reader, const byte * buffer, size_t maxbytes, amf_arena_t * arena)
+{
+    memset(reader, 0, sizeof(amf_reader_t));
+    reader->direct = 1;
+    reader->pos = (const u_byte*) buffer;
+    reader->end = reader->pos + maxbytes;
+    reader->arena = arena;
+}
+
+
+/* the next n <= 8 bytes, in place for a buffer, NULL at the end of the input */
+static const u_byte * 
+amf_reader_take(amf_reader_t * reader, size_t n)
+{
+    const u_byte * p;
+    if (reader->direct) {
+        if ((size_t) (reader->end - reader->pos) < n) {
+            return NULL;
+        }
+        p = reader->pos;
+        reader->pos += n;
+        return p;
+    }
+    return (reader->read_proc(reader->scratch, n, reader->user_data) == n) ? reader->scratch : NULL;
+}
+
+
+/* copy the next n bytes */
+static int 
+amf_reader_copy(amf_reader_t * reader, void * out, size_t n)
+{
+    if (reader->direct) {
+        if ((size_t) (reader->end - reader->pos) < n) {
+            return 0;
+        }
+        memcpy(out, reader->pos, n);
+        reader->pos += n;
+        return 1;
     }
-    return out_list;
+    return reader->read_proc(out, n, reader->user_data) == n;
 }
 
 
-/* structure used to mimic a stream with a memory buffer */
-typedef struct __buffer_context {
-    byte * start_address;
-    byte * current_address;
-    size_t buffer_size;
-} buffer_context;
+/* charge size bytes of the decoded tree, 0 past the budget */
+static int 
+amf_reader_charge(amf_reader_t * reader, size_t size)
+{
+    if (reader->limits != NULL && reader->limits->max_bytes != 0) {
+        if (size > reader->limits->max_bytes - reader->bytes) {
+            return 0;
+        }
+        reader->bytes += size;
+    }
+    return 1;
+}
 
 
-/* callback function to mimic fread using a memory buffer */
-static size_t 
-buffer_read(void * out_buffer, size_t size, void * user_data)
+/* room for n elements in a list, the growth is charged as amf_list_reserve() makes it */
+static amf_code 
+amf_reader_reserve(amf_reader_t * reader, amf_list_t * list, u_int n)
 {
-    buffer_context *ctxt = (buffer_context*) user_data;
-    if (ctxt->current_address >= ctxt->start_address
-    &&  ctxt->current_address + size <= ctxt->start_address + ctxt->buffer_size) 
-    {
-        memcpy(out_buffer, ctxt->current_address, size);
-        ctxt->current_address += size;
-        return size;
+    u_int capacity;
+
+    if (n <= list->capacity) {
+        return AMF_ERROR_OK;
     }
-    return 0;
+    capacity = (list->capacity > 0) ? list->capacity * 2 : AMF_LIST_MIN_CAPACITY;
+    if (capacity < n) {
+        capacity = n;
+    }
+    if (!amf_reader_charge(reader, (size_t) (capacity - list->capacity + ((list->nodes == NULL) ? 2 : 0)) * sizeof(amf_node_t))) {
+        return AMF_ERROR_LIMIT;
+    }
+    return amf_list_reserve(list, capacity, reader->arena) ? AMF_ERROR_OK : AMF_ERROR_MEMORY;
 }
 
 
+static amf_data_t * amf_data_read_from(amf_reader_t * reader);
+
+
 /* callback function to mimic fwrite using a memory buffer */
 static size_t 
 buffer_write(const void * in_buffer, size_t size, void * user_data)
@@ -220,6 +747,8 @@ amf_data_new(amf_type type)
     if (data != NULL) {
         data->type = type;
         data->error_code = AMF_ERROR_OK;
+        data->flags = 0;
+        data->refs = 0;
     }
     return data;
 }
@@ -229,10 +758,52 @@ amf_data_new(amf_type type)
 amf_data_t * 
 amf_data_buffer_read(byte * buffer, size_t maxbytes)
 {
-    buffer_context ctxt;
-    ctxt.start_address = ctxt.current_address = buffer;
-    ctxt.buffer_size = maxbytes;
-    return amf_data_read(buffer_read, &ctxt);
+    amf_reader_t reader;
+    amf_reader_init_buffer(&reader, buffer, maxbytes, NULL);
+    return amf_data_read_from(&reader);
+}
+
+
+/* read AMF data from buffer into an arena */
+amf_data_t * 
+amf_data_buffer_read_arena(byte * buffer, size_t maxbytes, amf_arena_t * arena)
+{
+    amf_reader_t reader;
+    amf_reader_init_buffer(&reader, buffer, maxbytes, arena);
+    return amf_data_read_from(&reader);
+}
+
+
+/* read AMF data from buffer within limits */
+amf_data_t * 
+amf_data_buffer_read_limited(byte * buffer, size_t maxbytes, amf_arena_t * arena, const amf_limits_t * limits)
+{
+    amf_reader_t reader;
+    amf_reader_init_buffer(&reader, buffer, maxbytes, arena);
+    reader.limits = limits;
+    return amf_data_read_from(&reader);
+}
+
+
+/* read AMF data from buffer, object keys are shared through an intern table */
+amf_data_t * 
+amf_data_buffer_read_interned(byte * buffer, size_t maxbytes, amf_arena_t * arena, amf_intern_t * intern)
+{
+    amf_reader_t reader;
+    amf_reader_init_buffer(&reader, buffer, maxbytes, arena);
+    reader.intern = intern;
+    return amf_data_read_from(&reader);
+}
+
+
+/* read AMF data from buffer, strings are views into the buffer */
+amf_data_t * 
+amf_data_buffer_read_view(byte * buffer, size_t maxbytes, amf_arena_t * arena)
+{
+    amf_reader_t reader;
+    amf_reader_init_buffer(&reader, buffer, maxbytes, arena);
+    reader.borrow = 1;
+    return amf_data_read_from(&reader);
 }
 
 
@@ -268,6 +839,13 @@ amf_data_file_read(FILE * stream) {
 }
 
 
+/* load AMF data from a file stream within limits */
+amf_data_t * 
+amf_data_file_read_limited(FILE * stream, const amf_limits_t * limits) {
+    return amf_data_read_limited(file_read, stream, NULL, limits);
+}
+
+
 /* write AMF data into a file stream */
 size_t 
 amf_data_file_write(const amf_data_t * data, FILE * stream) {
@@ -275,228 +853,538 @@ amf_data_file_write(const amf_data_t * data, FILE * stream) {
 }
 
 
-/* read a number */
-static amf_data_t * 
-amf_number_read(amf_read_proc read_proc, void * user_data)
-{
-    u_int64 val;
-    if (read_proc(&val, sizeof(u_int64), user_data) == sizeof(u_int64)) {
-        return amf_number_new( swap64_be(val) );
-    }
-    return amf_data_error(AMF_ERROR_EOF);
+/* allocation of decoded data, from the arena when there is one */
+static void *
+amf_alloc(amf_arena_t * arena, size_t size) {
+    return (arena != NULL) ? amf_arena_alloc(arena, size) : malloc(size);
 }
 
 
-/* read a boolean */
-static amf_data_t * 
-amf_boolean_read(amf_read_proc read_proc, void * user_data) {
-    u_byte val;
-    if (read_proc(&val, sizeof(u_byte), user_data) == sizeof(u_byte)) {
-        return amf_boolean_new(val);
-    } else {
-        return amf_data_error(AMF_ERROR_EOF);
+static amf_data_t *
+amf_data_alloc(amf_arena_t * arena, amf_type type)
+{
+    amf_data_t * data = (amf_data_t*) amf_alloc(arena, sizeof(amf_data_t));
+    if (data != NULL) {
+        data->type = type;
+        data->error_code = AMF_ERROR_OK;
+        data->flags = (arena != NULL) ? AMF_DATA_FLAG_ARENA : 0;
+        data->refs = 0;
     }
+    return data;
 }
 
 
-/* read a string */
-static amf_data_t * 
-amf_string_read(amf_read_proc read_proc, void * user_data)
+static amf_data_t *
+amf_data_alloc_error(amf_arena_t * arena, amf_code error_code)
 {
-    u_short strsize;
-    byte *buffer;
-    
-    if (read_proc(&strsize, sizeof(u_short), user_data) < sizeof(u_short)) {
-        return amf_data_error(AMF_ERROR_EOF);
+    amf_data_t * data = amf_data_alloc(arena, AMF_TYPE_NULL);
+    if (data != NULL) {
+        data->error_code = error_code;
     }
+    return data;
+}
 
-    strsize = swap16_be(strsize);
 
-    if (strsize == 0) {
-        return amf_string_new(NULL, 0);
+/* read a number */
+static amf_data_t * 
+amf_number_read(amf_reader_t * reader)
+{
+    const u_byte * p = amf_reader_take(reader, 8);
+    amf_data_t * data;
+    if (p != NULL) {
+        data = amf_data_alloc(reader->arena, AMF_TYPE_NUMBER);
+        if (data != NULL) {
+            data->number_data = load_u_int64_be(p);
+        }
+        return data;
     }
+    return amf_data_alloc_error(reader->arena, AMF_ERROR_EOF);
+}
 
-    buffer = (byte*) calloc(strsize, sizeof(byte));
-    if (buffer == NULL) {
-        return NULL;
-    }
 
-    if (read_proc(buffer, strsize, user_data) == strsize) {
-        amf_data_t * data = amf_string_new(buffer, strsize);
-        free(buffer);
+/* read a boolean */
+static amf_data_t * 
+amf_boolean_read(amf_reader_t * reader)
+{
+    const u_byte * p = amf_reader_take(reader, 1);
+    amf_data_t * data;
+    if (p != NULL) {
+        data = amf_data_alloc(reader->arena, AMF_TYPE_BOOLEAN);
+        if (data != NULL) {
+            data->boolean_data = *p;
+        }
         return data;
-    } else {
-        free(buffer);
-        return amf_data_error(AMF_ERROR_EOF);
     }
+    return amf_data_alloc_error(reader->arena, AMF_ERROR_EOF);
 }
 
 
-/* read an object */
+/* read the bytes of a string of the given size, straight into its final buffer */
 static amf_data_t * 
-amf_object_read(amf_read_proc read_proc, void * user_data)
-{
-    amf_data_t *name;
-    amf_data_t *element;
-    amf_code error_code;
-    amf_data_t *data;
-    
-    data = amf_object_new();
+amf_string_read_bytes(amf_reader_t * reader, u_short strsize)
+{
+    amf_data_t * data;
+
+    if (!amf_reader_charge(reader, reader->borrow ? 0 : (size_t) strsize + 1)) {
+        return amf_data_alloc_error(reader->arena, AMF_ERROR_LIMIT);
+    }
+    data = amf_data_alloc(reader->arena, AMF_TYPE_STRING);
     if (data == NULL) {
         return NULL;
     }
+    data->string_data.size = strsize;
+    data->string_data.mbstr = NULL;
 
-    while (1) {
-        name = amf_string_read(read_proc, user_data);
-        error_code = amf_data_get_error_code(name);
-        if (error_code != AMF_ERROR_OK) {
-            /* invalid name: error */
-            amf_data_free(name);
+    /* borrowed view: point into the source buffer, no terminating NUL */
+    if (reader->borrow) {
+        if ((size_t) (reader->end - reader->pos) < strsize) {
             amf_data_free(data);
-            return amf_data_error(error_code);
+            return amf_data_alloc_error(reader->arena, AMF_ERROR_EOF);
         }
+        data->string_data.mbstr = (byte*) reader->pos;
+        data->flags |= AMF_DATA_FLAG_BORROWED;
+        reader->pos += strsize;
+        return data;
+    }
 
-        element = amf_data_read(read_proc, user_data);
-        error_code = amf_data_get_error_code(element);
-        if (error_code == AMF_ERROR_END_TAG || error_code == AMF_ERROR_UNKNOWN_TYPE) {
-            /* end tag or unknown element: end of data, exit loop */
-            amf_data_free(name);
-            amf_data_free(element);
-            break;
-        } else if (error_code != AMF_ERROR_OK) {
-            amf_data_free(name);
-            amf_data_free(data);
-            amf_data_free(element);
-            return amf_data_error(error_code);
-        }
+    data->string_data.mbstr = (byte*) amf_alloc(reader->arena, (size_t) strsize + 1);
+    if (data->string_data.mbstr == NULL) {
+        amf_data_free(data);
+        return NULL;
+    }
 
-        if (amf_object_add(data, (char *) amf_string_get_bytes(name), element) == NULL) {
-            amf_data_free(name);
-            amf_data_free(element);
-            amf_data_free(data);
-            return NULL;
-        } else {
-            amf_data_free(name);
-        }
+    if (strsize > 0 && !amf_reader_copy(reader, data->string_data.mbstr, strsize)) {
+        amf_data_free(data);
+        return amf_data_alloc_error(reader->arena, AMF_ERROR_EOF);
     }
+    data->string_data.mbstr[strsize] = '\0';
 
     return data;
 }
 
 
-/* read an associative array */
+/* read a string */
 static amf_data_t * 
-amf_associative_array_read(amf_read_proc read_proc, void * user_data)
+amf_string_read(amf_reader_t * reader)
 {
-    amf_data_t *name;
-    amf_data_t *element;
-    u_int size;
-    amf_code error_code;
-    amf_data_t * data;
-    
-    data = amf_associative_array_new();
-    if (data == NULL) {
-        return NULL;
+    const u_byte * p = amf_reader_take(reader, 2);
+    if (p == NULL) {
+        return amf_data_alloc_error(reader->arena, AMF_ERROR_EOF);
     }
+    return amf_string_read_bytes(reader, load_u_int16_be(p));
+}
 
-    /* we ignore the 32 bits array size marker */
-    if (read_proc(&size, sizeof(u_int), user_data) < sizeof(u_int)) {
-        amf_data_free(data);
-        return amf_data_error(AMF_ERROR_EOF);
-    }
 
-    while(1) {
-        name = amf_string_read(read_proc, user_data);
-        error_code = amf_data_get_error_code(name);
-        if (error_code != AMF_ERROR_OK) {
-            /* invalid name: error */
-            amf_data_free(name);
-            amf_data_free(data);
-            return amf_data_error(error_code);
+/* read an object key, from the intern table when there is one */
+static amf_data_t * 
+amf_key_read(amf_reader_t * reader)
+{
+    const u_byte * p;
+    u_short strsize;
+    amf_data_t * key;
+
+    if (reader->intern == NULL) {
+        if (!amf_reader_charge(reader, sizeof(amf_data_t))) {
+            return amf_data_alloc_error(reader->arena, AMF_ERROR_LIMIT);
         }
+        return amf_string_read(reader);
+    }
+    if ((p = amf_reader_take(reader, 2)) == NULL) {
+        return amf_data_alloc_error(reader->arena, AMF_ERROR_EOF);
+    }
+    strsize = load_u_int16_be(p);
+    if (strsize <= AMF_INTERN_MAX_SIZE && reader->direct && (size_t) (reader->end - reader->pos) >= strsize) {
+        key = amf_intern(reader->intern, (const byte*) reader->pos, strsize);
+    } else {
+        key = NULL;
+    }
+    if (key == NULL) {
+        /* too long, or the table is full */
+        if (!amf_reader_charge(reader, sizeof(amf_data_t))) {
+            return amf_data_alloc_error(reader->arena, AMF_ERROR_LIMIT);
+        }
+        return amf_string_read_bytes(reader, strsize);
+    }
+    reader->pos += strsize;
+    return key;
+}
+
 
-        element = amf_data_read(read_proc, user_data);
-        error_code = amf_data_get_error_code(element);
+/* big-endian double bits, a single swapped load where the compiler offers one */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define amf_load_number_bits(p, bits) \
+    do { memcpy(&(bits), (p), sizeof(u_int64)); (bits) = __builtin_bswap64(bits); } while (0)
+#else
+#define amf_load_number_bits(p, bits) \
+    do { (bits) = load_u_int64_be(p); } while (0)
+#endif
 
-        if (amf_string_get_size(name) == 0 || error_code == AMF_ERROR_END_TAG || error_code == AMF_ERROR_UNKNOWN_TYPE) {
-            /* end tag or unknown element: end of data, exit loop */
-            amf_data_free(name);
-            amf_data_free(element);
+#define AMF_NUMBER_ENTRY_SIZE   9   // type marker and double
+
+
+/* number of number entries at p, at most max */
+static u_int 
+amf_numbers_run(const u_byte * p, const u_byte * end, u_int max)
+{
+    size_t fit = (size_t) (end - p) / AMF_NUMBER_ENTRY_SIZE;
+    u_int n = (fit < max) ? (u_int) fit : max;
+    u_int i = 0;
+
+    /* AMF_TYPE_NUMBER is 0: four markers are checked with one test */
+    for (; i + 4 <= n; i += 4, p += 4 * AMF_NUMBER_ENTRY_SIZE) {
+        if ((p[0] | p[9] | p[18] | p[27]) != AMF_TYPE_NUMBER) {
             break;
-        } else if (error_code != AMF_ERROR_OK) {
-            amf_data_free(name);
-            amf_data_free(data);
-            amf_data_free(element);
-            return amf_data_error(error_code);
         }
-        
-        if (amf_associative_array_add(data, (char *) amf_string_get_bytes(name), element) == NULL) {
-            amf_data_free(name);
-            amf_data_free(element);
-            amf_data_free(data);
-            return NULL;
+    }
+    for (; i < n && p[0] == AMF_TYPE_NUMBER; ++i, p += AMF_NUMBER_ENTRY_SIZE) {
+    }
+    return i;
+}
+
+
+/* decode a run of number entries, marker included, into out */
+u_int 
+amf_numbers_decode(const void * buffer, size_t size, double * out, u_int max)
+{
+    const u_byte * p = (const u_byte*) buffer;
+    u_int n = amf_numbers_run(p, p + size, max);
+    u_int64 bits;
+    u_int i;
+
+    for (i = 0; i < n; ++i, p += AMF_NUMBER_ENTRY_SIZE) {
+        amf_load_number_bits(p + 1, bits);
+        memcpy(&out[i], &bits, sizeof(double));
+    }
+    return n;
+}
+
+
+/* bulk read of the number entries starting the rest of an array, at most max */
+static amf_code 
+amf_array_read_numbers(amf_reader_t * reader, amf_data_t * data, u_int max, u_int * count)
+{
+    u_int n = amf_numbers_run(reader->pos, reader->end, max);
+    amf_data_t * block = NULL;
+    amf_data_t * element;
+    amf_code e;
+    u_int i;
+
+    /* within limits only, the element past them is left to the regular path */
+    if (reader->limits != NULL) {
+        if (reader->limits->max_elements != 0 && n > reader->limits->max_elements - reader->elements) {
+            n = reader->limits->max_elements - reader->elements;
+        }
+        if (reader->limits->max_bytes != 0 && n > (reader->limits->max_bytes - reader->bytes) / sizeof(amf_data_t)) {
+            n = (u_int) ((reader->limits->max_bytes - reader->bytes) / sizeof(amf_data_t));
         }
-        amf_data_free(name);
+    }
+    *count = 0;
+    if (n == 0) {
+        return AMF_ERROR_OK;
+    }
+    if ((e = amf_reader_reserve(reader, &data->list_data, data->list_data.size + n)) != AMF_ERROR_OK) {
+        return (e == AMF_ERROR_LIMIT) ? AMF_ERROR_OK : e;
+    }
+    if (!amf_reader_charge(reader, n * sizeof(amf_data_t))) {
+        return AMF_ERROR_OK;
+    }
+    if (reader->arena != NULL && (block = (amf_data_t*) amf_arena_alloc(reader->arena, n * sizeof(amf_data_t))) == NULL) {
+        return AMF_ERROR_MEMORY;
     }
 
-    return data;
+    for (i = 0; i < n; ++i, reader->pos += AMF_NUMBER_ENTRY_SIZE) {
+        element = (block != NULL) ? &block[i] : (amf_data_t*) malloc(sizeof(amf_data_t));
+        if (element == NULL) {
+            data->list_data.nodes[data->list_data.size + 1].data = NULL;
+            data->list_data.encoded += (size_t) i * AMF_NUMBER_ENTRY_SIZE;
+            return AMF_ERROR_MEMORY;
+        }
+        element->type = AMF_TYPE_NUMBER;
+        element->error_code = AMF_ERROR_OK;
+        element->flags = (block != NULL) ? AMF_DATA_FLAG_ARENA : 0;
+        element->refs = 0;
+        amf_load_number_bits(reader->pos + 1, element->number_data);
+        /* room is reserved: appended in place */
+        data->list_data.nodes[++(data->list_data.size)].data = element;
+    }
+    data->list_data.nodes[data->list_data.size + 1].data = NULL;
+    /* data isn't linked to a parent yet */
+    data->list_data.encoded += (size_t) n * AMF_NUMBER_ENTRY_SIZE;
+    reader->elements += n;
+    *count = n;
+    return AMF_ERROR_OK;
 }
 
 
-/* read an array */
+/* read a date */
 static amf_data_t * 
-amf_array_read(amf_read_proc read_proc, void * user_data)
+amf_date_read(amf_reader_t * reader)
 {
-    size_t i;
-    amf_data_t * element;
-    amf_code error_code;
+    u_int64 milliseconds;
+    const u_byte * p;
     amf_data_t * data;
-    u_int array_size;
+    if ((p = amf_reader_take(reader, 8)) != NULL) {
+        milliseconds = load_u_int64_be(p);
+        if ((p = amf_reader_take(reader, 2)) != NULL) {
+            data = amf_data_alloc(reader->arena, AMF_TYPE_DATE);
+            if (data != NULL) {
+                data->date_data.milliseconds = milliseconds;
+                data->date_data.timezone = (short) load_u_int16_be(p);
+            }
+            return data;
+        }
+    }
+    return amf_data_alloc_error(reader->arena, AMF_ERROR_EOF);
+}
 
-    data = amf_array_new();
-    if (data == NULL) {
-        return NULL;
+
+/* one value: a leaf, or a container with its header read (elements or hint in count) */
+static amf_code 
+amf_value_read(amf_reader_t * reader, amf_data_t ** value, u_int * count)
+{
+    const u_byte * p = amf_reader_take(reader, 1);
+    amf_data_t * data;
+    amf_code e;
+    u_byte type;
+
+    *value = NULL;
+    *count = 0;
+    if (p == NULL) {
+        return AMF_ERROR_EOF;
     }
+    type = *p;
 
-    if (read_proc(&array_size, sizeof(u_int), user_data) < sizeof(u_int)) {
-        amf_data_free(data);
-        return amf_data_error(AMF_ERROR_EOF);
+    switch (type) {
+        case AMF_TYPE_NUMBER:
+        case AMF_TYPE_BOOLEAN:
+        case AMF_TYPE_STRING:
+        case AMF_TYPE_OBJECT:
+        case AMF_TYPE_NULL:
+        case AMF_TYPE_UNDEFINED:
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+        case AMF_TYPE_ARRAY:
+        case AMF_TYPE_DATE:
+            break;
+        /*case AMF_TYPE_REFERENCE:*/
+        /*case AMF_TYPE_SIMPLEOBJECT:*/
+        case AMF_TYPE_XML:
+        case AMF_TYPE_CLASS:
+            return AMF_ERROR_UNSUPPORTED_TYPE;
+        case AMF_TYPE_END:
+            return AMF_ERROR_END_TAG; /* end of composite object */
+        default:
+            return AMF_ERROR_UNKNOWN_TYPE;
     }
 
-    array_size = swap32_be(array_size);
+    /* counted before anything is allocated */
+    if (reader->limits != NULL && reader->limits->max_elements != 0 && reader->elements >= reader->limits->max_elements) {
+        return AMF_ERROR_LIMIT;
+    }
+    if (!amf_reader_charge(reader, sizeof(amf_data_t))) {
+        return AMF_ERROR_LIMIT;
+    }
+    ++(reader->elements);
 
-    for (i = 0; i < array_size; ++i) {
-        element = amf_data_read(read_proc, user_data);
-        error_code = amf_data_get_error_code(element);
-        if (error_code != AMF_ERROR_OK) {
-            amf_data_free(element);
-            amf_data_free(data);
-            return amf_data_error(error_code);
-        }
+    switch (type) {
+        case AMF_TYPE_NUMBER:
+            data = amf_number_read(reader);
+            break;
+        case AMF_TYPE_BOOLEAN:
+            data = amf_boolean_read(reader);
+            break;
+        case AMF_TYPE_STRING:
+            data = amf_string_read(reader);
+            break;
+        case AMF_TYPE_DATE:
+            data = amf_date_read(reader);
+            break;
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+        case AMF_TYPE_ARRAY:
+            /* the 32 bits size: elements of strict arrays, only a hint for associative ones */
+            if ((p = amf_reader_take(reader, 4)) == NULL) {
+                return AMF_ERROR_EOF;
+            }
+            *count = load_u_int32_be(p);
+            /* fall through */
+        default:
+            data = amf_data_alloc(reader->arena, type);
+            if (data != NULL && amf_data_is_container(data)) {
+                amf_list_init(&data->list_data);
+            }
+            break;
+    }
 
-        if (amf_array_push(data, element) == NULL) {
-            amf_data_free(element);
-            amf_data_free(data);
-            return NULL;
-        }
+    if (data == NULL) {
+        return AMF_ERROR_MEMORY;
+    }
+    if ((e = amf_data_get_error_code(data)) != AMF_ERROR_OK) {
+        amf_data_free(data);
+        return e;
     }
+    *value = data;
+    return AMF_ERROR_OK;
+}
 
+
+/* the pairs of an object are all read */
+static amf_data_t * 
+amf_object_read_done(amf_reader_t * reader, amf_data_t * data)
+{
+    amf_object_index(data, reader->arena);
     return data;
 }
 
 
-/* read a date */
+/* a container being filled by amf_data_read_from() */
+typedef struct amf_frame_s {
+    amf_data_t     *data;
+    amf_data_t     *name;           // key of the value being read, objects
+    u_int           remaining;      // elements left, strict arrays
+} amf_frame_t;
+
+#define AMF_READ_FRAMES     16      // frames on the C stack, deeper nesting takes the heap
+
+
+/*
+ * Iterative decoder: the containers being filled are kept on a stack of frames rather
+ * than on the call stack, a value is linked to its container once complete.
+ */
 static amf_data_t * 
-amf_date_read(amf_read_proc read_proc, void * user_data)
+amf_data_read_from(amf_reader_t * reader)
 {
-    u_int64 milliseconds;
-    short timezone;
-    if (read_proc(&milliseconds, sizeof(u_int64), user_data) == sizeof(u_int64)
-    &&  read_proc(&timezone, sizeof(short), user_data) == sizeof(short))
-    {
-        return amf_date_new( swap64_be(milliseconds) , swap16_be(timezone) );
+    amf_frame_t frames[AMF_READ_FRAMES];
+    amf_frame_t * stack = frames;
+    amf_frame_t * grown;
+    amf_frame_t * top;
+    u_int capacity = AMF_READ_FRAMES;
+    u_int depth = 0;
+    amf_data_t * value = NULL;
+    amf_code e;
+    u_int count;
+
+    while (1) {
+        top = (depth > 0) ? &stack[depth - 1] : NULL;
+
+        /* the next element of the innermost container, or its end */
+        if (top != NULL && top->data->type == AMF_TYPE_ARRAY) {
+            /* keyframe tables: runs of numbers are decoded in bulk from buffers */
+            if (top->remaining > 0 && reader->direct && reader->pos < reader->end && *reader->pos == AMF_TYPE_NUMBER) {
+                if ((e = amf_array_read_numbers(reader, top->data, top->remaining, &count)) != AMF_ERROR_OK) {
+                    goto fail;
+                }
+                top->remaining -= count;
+            }
+            if (top->remaining == 0) {
+                value = top->data;
+                --depth;
+            } else {
+                --(top->remaining);
+            }
+        } else if (top != NULL) {
+            top->name = amf_key_read(reader);
+            if ((e = amf_data_get_error_code(top->name)) != AMF_ERROR_OK) {
+                e = (top->name == NULL) ? AMF_ERROR_MEMORY : e;
+                goto fail;
+            }
+        }
+
+        if (value == NULL) {
+            e = amf_value_read(reader, &value, &count);
+            if (e == AMF_ERROR_OK && amf_data_is_container(value)) {
+                if (reader->limits != NULL && reader->limits->max_depth != 0 && depth >= reader->limits->max_depth) {
+                    e = AMF_ERROR_LIMIT;
+                    goto fail;
+                }
+                if (depth == capacity) {
+                    grown = (amf_frame_t*) malloc(capacity * 2 * sizeof(amf_frame_t));
+                    if (grown == NULL) {
+                        e = AMF_ERROR_MEMORY;
+                        goto fail;
+                    }
+                    memcpy(grown, stack, capacity * sizeof(amf_frame_t));
+                    if (stack != frames) {
+                        free(stack);
+                    }
+                    stack = grown;
+                    capacity *= 2;
+                }
+                top = &stack[depth++];
+                top->data = value;
+                top->name = NULL;
+                top->remaining = (value->type == AMF_TYPE_ARRAY) ? count : 0;
+                if (value->type == AMF_TYPE_ARRAY) {
+                    amf_reader_reserve(reader, &value->list_data, (count < AMF_LIST_MAX_HINT) ? count : AMF_LIST_MAX_HINT);
+                } else if (value->type == AMF_TYPE_ASSOCIATIVE_ARRAY) {
+                    amf_reader_reserve(reader, &value->list_data, ((count < AMF_LIST_MAX_HINT) ? count : AMF_LIST_MAX_HINT) * 2);
+                }
+                value = NULL;
+                continue;
+            }
+            if (e != AMF_ERROR_OK) {
+                if (top == NULL || top->data->type == AMF_TYPE_ARRAY || e == AMF_ERROR_LIMIT || e == AMF_ERROR_MEMORY) {
+                    goto fail;
+                }
+                /* end tag or unknown element: end of the object, so is an empty key in associative arrays */
+                if (e != AMF_ERROR_END_TAG && e != AMF_ERROR_UNKNOWN_TYPE
+                &&  !(top->data->type == AMF_TYPE_ASSOCIATIVE_ARRAY && amf_string_get_size(top->name) == 0))
+                {
+                    goto fail;
+                }
+                amf_data_free(top->name);
+                top->name = NULL;
+                value = amf_object_read_done(reader, top->data);
+                --depth;
+            }
+        }
+
+        /* link the value to its container, which an empty key may end in turn */
+        while (1) {
+            if (depth == 0) {
+                if (stack != frames) {
+                    free(stack);
+                }
+                return value;
+            }
+            top = &stack[depth - 1];
+
+            if (top->data->type == AMF_TYPE_ARRAY) {
+                if ((e = amf_reader_reserve(reader, &top->data->list_data, top->data->list_data.size + 1)) != AMF_ERROR_OK) {
+                    goto fail;
+                }
+                amf_list_push_arena(&top->data->list_data, value, reader->arena);
+                break;
+            }
+            if (top->data->type == AMF_TYPE_ASSOCIATIVE_ARRAY && amf_string_get_size(top->name) == 0) {
+                amf_data_free(top->name);
+                amf_data_free(value);
+                top->name = NULL;
+                value = amf_object_read_done(reader, top->data);
+                --depth;
+                continue;
+            }
+            /* the decoded name is linked as is, no copy */
+            if ((e = amf_reader_reserve(reader, &top->data->list_data, top->data->list_data.size + 2)) != AMF_ERROR_OK) {
+                goto fail;
+            }
+            amf_list_push_arena(&top->data->list_data, top->name, reader->arena);
+            amf_list_push_arena(&top->data->list_data, value, reader->arena);
+            top->name = NULL;
+            break;
+        }
+        value = NULL;
+    }
+
+fail:
+    amf_data_free(value);
+    while (depth > 0) {
+        --depth;
+        amf_data_free(stack[depth].name);
+        amf_data_free(stack[depth].data);
+    }
+    if (stack != frames) {
+        free(stack);
     }
-    return amf_data_error(AMF_ERROR_EOF);
+    return (e == AMF_ERROR_MEMORY) ? NULL : amf_data_alloc_error(reader->arena, e);
 }
 
 
@@ -504,41 +1392,30 @@ amf_date_read(amf_read_proc read_proc, void * user_data)
 amf_data_t * 
 amf_data_read(amf_read_proc read_proc, void * user_data)
 {
-    u_byte type;
-    if (read_proc(&type, sizeof(u_byte), user_data) < sizeof(u_byte)) {
-        return amf_data_error(AMF_ERROR_EOF);
-    }
+    amf_reader_t reader;
+    amf_reader_init_stream(&reader, read_proc, user_data, NULL);
+    return amf_data_read_from(&reader);
+}
+
+
+/* load AMF data from stream, the whole tree lives in the arena */
+amf_data_t * 
+amf_data_read_arena(amf_read_proc read_proc, void * user_data, amf_arena_t * arena)
+{
+    amf_reader_t reader;
+    amf_reader_init_stream(&reader, read_proc, user_data, arena);
+    return amf_data_read_from(&reader);
+}
 
 
-    switch (type) {
-        case AMF_TYPE_NUMBER:
-            return amf_number_read(read_proc, user_data);
-        case AMF_TYPE_BOOLEAN:
-            return amf_boolean_read(read_proc, user_data);
-        case AMF_TYPE_STRING:
-            return amf_string_read(read_proc, user_data);
-        case AMF_TYPE_OBJECT:
-            return amf_object_read(read_proc, user_data);
-        case AMF_TYPE_NULL:
-            return amf_null_new();
-        case AMF_TYPE_UNDEFINED:
-            return amf_undefined_new();
-        /*case AMF_TYPE_REFERENCE:*/
-        case AMF_TYPE_ASSOCIATIVE_ARRAY:
-            return amf_associative_array_read(read_proc, user_data);
-        case AMF_TYPE_ARRAY:
-            return amf_array_read(read_proc, user_data);
-        case AMF_TYPE_DATE:
-            return amf_date_read(read_proc, user_data);
-        /*case AMF_TYPE_SIMPLEOBJECT:*/
-        case AMF_TYPE_XML:
-        case AMF_TYPE_CLASS:
-            return amf_data_error(AMF_ERROR_UNSUPPORTED_TYPE);
-        case AMF_TYPE_END:
-            return amf_data_error(AMF_ERROR_END_TAG); /* end of composite object */
-        default:
-            return amf_data_error(AMF_ERROR_UNKNOWN_TYPE);
-    }
+/* load AMF data from stream within limits */
+amf_data_t * 
+amf_data_read_limited(amf_read_proc read_proc, void * user_data, amf_arena_t * arena, const amf_limits_t * limits)
+{
+    amf_reader_t reader;
+    amf_reader_init_stream(&reader, read_proc, user_data, arena);
+    reader.limits = limits;
+    return amf_data_read_from(&reader);
 }
 
 
@@ -547,7 +1424,6 @@ size_t
 amf_data_size(const amf_data_t * data)
 {
     size_t s = 0;
-    amf_node_t * node;
     if (data != NULL) {
         s += sizeof(byte);
         switch (data->type) {
@@ -561,36 +1437,13 @@ amf_data_size(const amf_data_t * data)
                 s += sizeof(u_short) + (size_t) amf_string_get_size(data);
                 break;
             case AMF_TYPE_OBJECT:
-                node = amf_object_first(data);
-                while (node != NULL) {
-                    s += sizeof(u_short) + (size_t) amf_string_get_size(amf_object_get_name(node));
-                    s += (size_t) amf_data_size(amf_object_get_data(node));
-                    node = amf_object_next(node);
-                }
-                s += sizeof(u_short) + sizeof(u_byte);
-                break;
+            case AMF_TYPE_ASSOCIATIVE_ARRAY:
+            case AMF_TYPE_ARRAY:
+                return amf_container_size(data->type, data->list_data.encoded, data->list_data.size);
             case AMF_TYPE_NULL:
             case AMF_TYPE_UNDEFINED:
                 break;
             /*case AMF_TYPE_REFERENCE:*/
-            case AMF_TYPE_ASSOCIATIVE_ARRAY:
-                s += sizeof(u_int);
-                node = amf_associative_array_first(data);
-                while (node != NULL) {
-                    s += sizeof(u_short) + (size_t) amf_string_get_size(amf_associative_array_get_name(node));
-                    s += (size_t) amf_data_size(amf_associative_array_get_data(node));
-                    node = amf_associative_array_next(node);
-                }
-                s += sizeof(u_short) + sizeof(u_byte);
-                break;
-            case AMF_TYPE_ARRAY:
-                s += sizeof(u_int);
-                node = amf_array_first(data);
-                while (node != NULL) {
-                    s += (size_t) amf_data_size(amf_array_get(node));
-                    node = amf_array_next(node);
-                }
-                break;
             case AMF_TYPE_DATE:
                 s += sizeof(u_int64) + sizeof(short);
                 break;
@@ -612,6 +1465,7 @@ static size_t
 amf_number_write(const amf_data_t * data, amf_write_proc write_proc, void * user_data)
 {
     u_int64 n = data->number_data;
+    n = swap64_be(n);
     return write_proc(&n, sizeof(u_int64), user_data);
 }
 
@@ -631,6 +1485,7 @@ amf_string_write(const amf_data_t * data, amf_write_proc write_proc, void * user
     size_t w = 0;
 
     s = data->string_data.size;
+    s = swap16_be(s);
     w = write_proc(&s, sizeof(u_short), user_data);
     if (data->string_data.size > 0) {
         w += write_proc(data->string_data.mbstr, (size_t) (data->string_data.size), user_data);
@@ -676,6 +1531,7 @@ amf_associative_array_write(const amf_data_t * data, amf_write_proc write_proc,
     u_byte terminator = AMF_TYPE_END;
 
     s = data->list_data.size / 2;
+    s = swap32_be(s);
     w += write_proc(&s, sizeof(u_int), user_data);
     node = amf_associative_array_first(data);
     while (node != NULL) {
@@ -702,6 +1558,7 @@ amf_array_write(const amf_data_t * data, amf_write_proc write_proc, void * user_
     u_int s;
 
     s = data->list_data.size;
+    s = swap32_be(s);
     w += write_proc(&s, sizeof(u_int), user_data);
     node = amf_array_first(data);
     while (node != NULL) {
@@ -722,8 +1579,10 @@ amf_date_write(const amf_data_t * data, amf_write_proc write_proc, void * user_d
     short tz;
 
     milli = data->date_data.milliseconds;
+    milli = swap64_be(milli);
     w += write_proc(&milli, sizeof(u_int64), user_data);
     tz = data->date_data.timezone;
+    tz = (short) swap16_be(tz);
     w += write_proc(&tz, sizeof(short), user_data);
 
     return w;
@@ -776,6 +1635,171 @@ amf_data_write(const amf_data_t * data, amf_write_proc write_proc, void * user_d
 }
 
 
+/* growable output buffer */
+void 
+amf_buffer_init(amf_buffer_t * buffer, amf_arena_t * arena)
+{
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+    buffer->arena = arena;
+    buffer->error = 0;
+}
+
+
+void 
+amf_buffer_free(amf_buffer_t * buffer)
+{
+    if (buffer->arena == NULL) {
+        free(buffer->data);
+    }
+    amf_buffer_init(buffer, buffer->arena);
+}
+
+
+/* make room for n more bytes */
+static int 
+amf_buffer_grow(amf_buffer_t * buffer, size_t n)
+{
+    size_t capacity = (buffer->capacity > 0) ? buffer->capacity : AMF_BUFFER_MIN_CAPACITY;
+    u_byte * data;
+
+    while (capacity < buffer->size + n) {
+        capacity *= 2;
+    }
+    if (buffer->arena != NULL) {
+        data = (u_byte*) amf_arena_alloc(buffer->arena, capacity);
+        if (data != NULL && buffer->size > 0) {
+            memcpy(data, buffer->data, buffer->size);
+        }
+    } else {
+        data = (u_byte*) realloc(buffer->data, capacity);
+    }
+    if (data == NULL) {
+        buffer->error = 1;
+        return 0;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+
+#define amf_buffer_ensure(buffer, n) \
+    ((buffer)->capacity - (buffer)->size >= (n) || amf_buffer_grow((buffer), (n)))
+
+
+u_byte * 
+amf_buffer_reserve(amf_buffer_t * buffer, size_t n)
+{
+    return amf_buffer_ensure(buffer, n) ? buffer->data + buffer->size : NULL;
+}
+
+
+static void 
+amf_string_encode(const amf_data_t * data, amf_buffer_t * buffer)
+{
+    u_short size = data->string_data.size;
+    if (amf_buffer_ensure(buffer, (size_t) 2 + size)) {
+        store_u_int16_be(buffer->data + buffer->size, size);
+        if (size > 0) {
+            memcpy(buffer->data + buffer->size + 2, data->string_data.mbstr, size);
+        }
+        buffer->size += (size_t) 2 + size;
+    }
+}
+
+
+static void amf_data_encode_value(const amf_data_t * data, amf_buffer_t * buffer);
+
+
+/* name / value pairs and the end marker */
+static void 
+amf_object_encode(const amf_data_t * data, amf_buffer_t * buffer)
+{
+    amf_node_t * node;
+    for (node = amf_object_first(data); node != NULL && !buffer->error; node = amf_object_next(node)) {
+        amf_string_encode(amf_object_get_name(node), buffer);
+        amf_data_encode_value(amf_object_get_data(node), buffer);
+    }
+    if (amf_buffer_ensure(buffer, 3)) {
+        store_u_int24_be(buffer->data + buffer->size, AMF_TYPE_END);
+        buffer->size += 3;
+    }
+}
+
+
+static void 
+amf_data_encode_value(const amf_data_t * data, amf_buffer_t * buffer)
+{
+    u_byte * p;
+    u_int i;
+
+    if (data == NULL || !amf_buffer_ensure(buffer, 11)) {
+        return;
+    }
+    /* fixed size fields of at most 11 bytes are written in place */
+    p = buffer->data + buffer->size;
+    p[0] = data->type;
+
+    switch (data->type) {
+        case AMF_TYPE_NUMBER:
+            store_u_int32_be(p + 1, (u_int) (data->number_data >> 32));
+            store_u_int32_be(p + 5, (u_int) data->number_data);
+            buffer->size += 9;
+            break;
+        case AMF_TYPE_BOOLEAN:
+            p[1] = data->boolean_data;
+            buffer->size += 2;
+            break;
+        case AMF_TYPE_STRING:
+            buffer->size += 1;
+            amf_string_encode(data, buffer);
+            break;
+        case AMF_TYPE_OBJECT:
+            buffer->size += 1;
+            amf_object_encode(data, buffer);
+            break;
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+            store_u_int32_be(p + 1, data->list_data.size / 2);
+            buffer->size += 5;
+            amf_object_encode(data, buffer);
+            break;
+        case AMF_TYPE_ARRAY:
+            store_u_int32_be(p + 1, data->list_data.size);
+            buffer->size += 5;
+            for (i = 1; i <= data->list_data.size && !buffer->error; ++i) {
+                amf_data_encode_value(data->list_data.nodes[i].data, buffer);
+            }
+            break;
+        case AMF_TYPE_DATE:
+            store_u_int32_be(p + 1, (u_int) (data->date_data.milliseconds >> 32));
+            store_u_int32_be(p + 5, (u_int) data->date_data.milliseconds);
+            store_u_int16_be(p + 9, (u_short) data->date_data.timezone);
+            buffer->size += 11;
+            break;
+        default:
+            /* null, undefined, and the types written as their marker only */
+            buffer->size += 1;
+            break;
+    }
+}
+
+
+/* encode AMF data at the end of the buffer in one pass */
+size_t 
+amf_data_encode(const amf_data_t * data, amf_buffer_t * buffer)
+{
+    size_t start = buffer->size;
+    amf_data_encode_value(data, buffer);
+    if (buffer->error) {
+        buffer->size = start;
+        return 0;
+    }
+    return buffer->size - start;
+}
+
+
 /* data type */
 amf_type 
 amf_data_get_type(const amf_data_t * data) {
@@ -800,14 +1824,13 @@ amf_data_clone(const amf_data_t * data)
         case AMF_TYPE_NUMBER:       return amf_number_new(amf_number_get_value(data));
         case AMF_TYPE_BOOLEAN:      return amf_boolean_new(amf_boolean_get_value(data));
         case AMF_TYPE_STRING:
+            /* interned keys too, the copy outlives the intern table */
             if (data->string_data.mbstr != NULL) {
-                return amf_string_new(
-                    (byte*) strdup((char*) amf_string_get_bytes(data)) , 
-                    amf_string_get_size(data));
+                return amf_string_new((char*) amf_string_get_bytes(data), amf_string_get_size(data));
             }
             return amf_str(NULL);
-        case AMF_TYPE_NULL:         return NULL;
-        case AMF_TYPE_UNDEFINED:    return NULL;
+        case AMF_TYPE_NULL:         return amf_null_new();
+        case AMF_TYPE_UNDEFINED:    return amf_undefined_new();
         /*case AMF_TYPE_REFERENCE:*/
         case AMF_TYPE_OBJECT:
         case AMF_TYPE_ASSOCIATIVE_ARRAY:
@@ -817,6 +1840,7 @@ amf_data_clone(const amf_data_t * data)
                 if (d != NULL) {
                     amf_list_init(&d->list_data);
                     amf_list_clone(&data->list_data, &d->list_data);
+                    amf_object_index(d, NULL);
                 }
                 return d;
             }
@@ -830,16 +1854,130 @@ amf_data_clone(const amf_data_t * data)
 }
 
 
+/* drop one share, returns 1 when there is none: the caller is the last owner */
+static int 
+amf_data_release(amf_data_t * data)
+{
+    u_int refs = amf_data_refs(data);
+    while (refs > 0) {
+        if (amf_refs_decrement(data, refs)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/* mark a tree read-only, the values already frozen have their elements frozen too */
+static void 
+amf_data_freeze(amf_data_t * data)
+{
+    u_int i;
+
+    if (data->flags & (AMF_DATA_FLAG_FROZEN | AMF_DATA_FLAG_INTERNED)) {
+        return;
+    }
+    data->flags |= AMF_DATA_FLAG_FROZEN;
+    if (amf_data_is_container(data)) {
+        for (i = 1; i <= data->list_data.size; ++i) {
+            amf_data_freeze(data->list_data.nodes[i].data);
+        }
+    }
+}
+
+
+/* a value held by one owner only becomes writable again, its elements stay frozen */
+static void 
+amf_data_thaw(amf_data_t * data, amf_data_t * parent)
+{
+    data->flags &= (u_byte) ~AMF_DATA_FLAG_FROZEN;
+    if (amf_data_is_container(data)) {
+        data->list_data.parent = parent;
+    }
+}
+
+
+amf_data_t * 
+amf_data_share(amf_data_t * data)
+{
+    if (data == NULL || (data->flags & AMF_DATA_FLAG_INTERNED)) {
+        return data;
+    }
+    if (data->flags & AMF_DATA_FLAG_ARENA) {
+        return amf_data_clone(data);
+    }
+    amf_data_freeze(data);
+    amf_refs_increment(data);
+    return data;
+}
+
+
+/* copy on write: the top level is copied, the elements are shared */
+amf_data_t * 
+amf_data_unshare(amf_data_t * data)
+{
+    amf_data_t * copy;
+    u_int i;
+
+    if (data == NULL) {
+        return NULL;
+    }
+    if (amf_data_refs(data) == 0) {
+        /* the last owner, the value is a top level one again */
+        if (data->flags & AMF_DATA_FLAG_FROZEN) {
+            amf_data_thaw(data, NULL);
+        }
+        return data;
+    }
+    if (!amf_data_is_container(data)) {
+        copy = amf_data_clone(data);
+    } else {
+        copy = amf_data_new(data->type);
+        if (copy != NULL) {
+            amf_list_init(&copy->list_data);
+            if (!amf_list_reserve(&copy->list_data, data->list_data.size, NULL)) {
+                amf_data_free(copy);
+                return NULL;
+            }
+            for (i = 1; i <= data->list_data.size; ++i) {
+                copy->list_data.nodes[i].data = amf_data_share(data->list_data.nodes[i].data);
+                if (copy->list_data.nodes[i].data == NULL) {
+                    copy->list_data.size = i - 1;
+                    amf_data_free(copy);
+                    return NULL;
+                }
+            }
+            copy->list_data.size = data->list_data.size;
+            if (copy->list_data.nodes != NULL) {
+                copy->list_data.nodes[copy->list_data.size + 1].data = NULL;
+            }
+            copy->list_data.encoded = data->list_data.encoded;
+            amf_object_index(copy, NULL);
+        }
+    }
+    if (copy != NULL) {
+        /* the other owners may have let go meanwhile */
+        amf_data_free(data);
+    }
+    return copy;
+}
+
+
 /* free AMF data */
 void 
 amf_data_free(amf_data_t * data)
 {
-    if (data != NULL) {
+    /* other owners keep it */
+    if (data == NULL || !amf_data_release(data)) {
+        return;
+    }
+    /* arena data is released with its arena, interned keys with their table */
+    if (data != NULL && !(data->flags & (AMF_DATA_FLAG_ARENA | AMF_DATA_FLAG_INTERNED))) {
         switch (data->type) {
         case AMF_TYPE_NUMBER: break;
         case AMF_TYPE_BOOLEAN: break;
         case AMF_TYPE_STRING:
-            if (data->string_data.mbstr != NULL) {
+            if (data->string_data.mbstr != NULL && !(data->flags & AMF_DATA_FLAG_BORROWED)) {
                 free(data->string_data.mbstr);
             } 
             break;
@@ -984,12 +2122,41 @@ amf_number_get_value(const amf_data_t * data) {
 
 void 
 amf_number_set_value(amf_data_t * data, u_int64 value) {
-    if (data != NULL) {
+    if (amf_data_writable(data)) {
         data->number_data = value;
     }
 }
 
 
+/* numbers hold the bits of an IEEE 754 double */
+amf_data_t * 
+amf_number_new_double(double value)
+{
+    u_int64 bits;
+    memcpy(&bits, &value, sizeof(u_int64));
+    return amf_number_new(bits);
+}
+
+
+double 
+amf_number_get_double(const amf_data_t * data)
+{
+    double value = 0;
+    if (data != NULL) {
+        memcpy(&value, &data->number_data, sizeof(double));
+    }
+    return value;
+}
+
+
+void 
+amf_number_set_double(amf_data_t * data, double value) {
+    if (amf_data_writable(data)) {
+        memcpy(&data->number_data, &value, sizeof(double));
+    }
+}
+
+
 /* boolean functions */
 amf_data_t * 
 amf_boolean_new(u_byte value)
@@ -1010,7 +2177,7 @@ amf_boolean_get_value(const amf_data_t * data) {
 
 void 
 amf_boolean_set_value(amf_data_t * data, u_byte value) {
-    if (data != NULL) {
+    if (amf_data_writable(data)) {
         data->boolean_data = value;
     }
 }
@@ -1082,14 +2249,27 @@ amf_object_size(const amf_data_t * data) {
 amf_data_t * 
 amf_object_add(amf_data_t * data, const char * name, amf_data_t * element)
 {
-    if (data != NULL) {
+    amf_hash_t * hash;
+    if (amf_data_resizable(data)) {
+        /* appending keeps the key index, which is set aside during the pushes */
+        hash = data->list_data.hash;
+        data->list_data.hash = NULL;
         if (amf_list_push(&data->list_data, amf_str(name)) != NULL) {
             if (amf_list_push(&data->list_data, element) != NULL) {
+                data->list_data.hash = hash;
+                if (hash == NULL) {
+                    amf_object_index(data, NULL);
+                } else if ((hash->count + 1) * 2 > hash->mask + 1) {
+                    amf_hash_build(&data->list_data, NULL);
+                } else {
+                    amf_hash_insert(&data->list_data, data->list_data.size - 1);
+                }
                 return element;
             } else {
                 amf_data_free(amf_list_pop(&data->list_data));
             }
         }
+        data->list_data.hash = hash;
     }
     return NULL;
 }
@@ -1098,16 +2278,54 @@ amf_object_add(amf_data_t * data, const char * name, amf_data_t * element)
 amf_data_t * 
 amf_object_get(const amf_data_t * data, const char * name)
 {
-    if (data != NULL) {
-        amf_node_t * node = amf_list_first(&(data->list_data));
-        while (node != NULL) {
-            if (strncmp((char*)(node->data->string_data.mbstr), name, (size_t) (node->data->string_data.size)) == 0) {
-                node = node->next;
-                return (node != NULL) ? node->data : NULL;
-            }
-            /* we have to skip the element data to reach the next name */
-            node = node->next->next;
+    amf_node_t * node;
+    if (data != NULL && name != NULL) {
+        node = amf_object_find(data, name);
+        return (node != NULL) ? node[1].data : NULL;
+    }
+    return NULL;
+}
+
+
+amf_data_t * 
+amf_object_get_key(const amf_data_t * data, const amf_data_t * key)
+{
+    amf_node_t * node;
+    if (data != NULL && key != NULL && key->type == AMF_TYPE_STRING) {
+        node = amf_object_find_key(data, key, key->string_data.mbstr, key->string_data.size, amf_name_hash(key));
+        return (node != NULL) ? node[1].data : NULL;
+    }
+    return NULL;
+}
+
+
+/* make the element of a writable container at node writable */
+static amf_data_t * 
+amf_list_get_mutable(amf_data_t * data, amf_node_t * node)
+{
+    amf_data_t * element = node->data;
+    amf_data_t * copy;
+
+    if (amf_data_refs(element) > 0) {
+        /* same encoded size, the sums above don't change */
+        if ((copy = amf_data_unshare(element)) == NULL) {
+            return NULL;
         }
+        node->data = element = copy;
+    }
+    /* held by this container only */
+    amf_data_thaw(element, data);
+    return element;
+}
+
+
+amf_data_t * 
+amf_object_get_mutable(amf_data_t * data, const char * name)
+{
+    amf_node_t * node;
+    if (amf_data_writable(data) && name != NULL) {
+        node = amf_object_find(data, name);
+        return (node != NULL) ? amf_list_get_mutable(data, &node[1]) : NULL;
     }
     return NULL;
 }
@@ -1116,19 +2334,15 @@ amf_object_get(const amf_data_t * data, const char * name)
 amf_data_t * 
 amf_object_set(amf_data_t * data, const char * name, amf_data_t * element)
 {
-    if (data != NULL) {
-        amf_node_t * node = amf_list_first(&(data->list_data));
-        while (node != NULL) {
-            if (strncmp((char*) (node->data->string_data.mbstr), name, (size_t) (node->data->string_data.size)) == 0) {
-                node = node->next;
-                if (node != NULL && node->data != NULL) {
-                    amf_data_free(node->data);
-                    node->data = element;
-                    return element;
-                }
-            }
-            /* we have to skip the element data to reach the next name */
-            node = node->next->next;
+    amf_node_t * node;
+    if (amf_data_resizable(data) && name != NULL && element != NULL) {
+        node = amf_object_find(data, name);
+        if (node != NULL) {
+            amf_list_account(&data->list_data, node[1].data, 0, data->list_data.size);
+            amf_data_free(node[1].data);
+            node[1].data = element;
+            amf_list_account(&data->list_data, element, 1, data->list_data.size);
+            return element;
         }
     }
     return NULL;
@@ -1138,17 +2352,16 @@ amf_object_set(amf_data_t * data, const char * name, amf_data_t * element)
 amf_data_t * 
 amf_object_delete(amf_data_t * data, const char * name)
 {
-    if (data != NULL) {
-        amf_node_t * node = amf_list_first(&data->list_data);
-        while (node != NULL) {
-            node = node->next;
-            if (strncmp((char*) (node->data->string_data.mbstr), name, (size_t) (node->data->string_data.size)) == 0) {
-                amf_node_t * data_node = node->next;
-                amf_data_free( amf_list_delete(&data->list_data, node) );
-                return amf_list_delete(&data->list_data, data_node);
-            } else {
-                node = node->next;
-            }
+    amf_data_t * element;
+    amf_node_t * node;
+    if (amf_data_resizable(data) && name != NULL) {
+        node = amf_object_find(data, name);
+        if (node != NULL) {
+            /* the value slides into the name slot */
+            amf_data_free( amf_list_delete(&data->list_data, node) );
+            element = amf_list_delete(&data->list_data, node);
+            amf_object_index(data, NULL);
+            return element;
         }
     }
     return NULL;
@@ -1157,46 +2370,26 @@ amf_object_delete(amf_data_t * data, const char * name)
 
 amf_node_t * 
 amf_object_first(const amf_data_t * data) {
-    return (data != NULL) ? amf_list_first(&data->list_data) : NULL;
+    return (data != NULL && data->list_data.size >= 2) ? &data->list_data.nodes[1] : NULL;
 }
 
 
 amf_node_t * 
-amf_object_last(const amf_data_t * data)
-{
-    if (data != NULL) {
-        amf_node_t * node = amf_list_last(&data->list_data);
-        if (node != NULL) {
-            return node->prev;
-        }
-    }
-    return NULL;
+amf_object_last(const amf_data_t * data) {
+    return (data != NULL && data->list_data.size >= 2) ? &data->list_data.nodes[data->list_data.size - 1] : NULL;
 }
 
 
+/* names and values alternate, the sentinels end the walk */
 amf_node_t * 
-amf_object_next(amf_node_t * node)
-{
-    if (node != NULL) {
-        amf_node_t * next = node->next;
-        if (next != NULL) {
-            return next->next;
-        }
-    }
-    return NULL;
+amf_object_next(amf_node_t * node) {
+    return (node != NULL && node[1].data != NULL && node[2].data != NULL) ? node + 2 : NULL;
 }
 
 
 amf_node_t * 
-amf_object_prev(amf_node_t * node)
-{
-    if (node != NULL) {
-        amf_node_t * prev = node->prev;
-        if (prev != NULL) {
-            return prev->prev;
-        }
-    }
-    return NULL;
+amf_object_prev(amf_node_t * node) {
+    return (node != NULL && node[-1].data != NULL) ? node - 2 : NULL;
 }
 
 
@@ -1207,15 +2400,8 @@ amf_object_get_name(amf_node_t * node) {
 
 
 amf_data_t * 
-amf_object_get_data(amf_node_t * node)
-{
-    if (node != NULL) {
-        amf_node_t * next = node->next;
-        if (next != NULL) {
-            return next->data;
-        }
-    }
-    return NULL;
+amf_object_get_data(amf_node_t * node) {
+    return (node != NULL) ? node[1].data : NULL;
 }
 
 
@@ -1250,12 +2436,12 @@ amf_array_size(const amf_data_t * data) {
 
 amf_data_t * 
 amf_array_push(amf_data_t * data, amf_data_t * element) {
-    return (data != NULL) ? amf_list_push(&data->list_data, element) : NULL;
+    return amf_data_resizable(data) ? amf_list_push(&data->list_data, element) : NULL;
 }
 
 amf_data_t * 
 amf_array_pop(amf_data_t * data) {
-    return (data != NULL) ? amf_list_pop(&data->list_data) : NULL;
+    return amf_data_resizable(data) ? amf_list_pop(&data->list_data) : NULL;
 }
 
 amf_node_t * 
@@ -1270,12 +2456,12 @@ amf_array_last(const amf_data_t * data) {
 
 amf_node_t * 
 amf_array_next(amf_node_t * node) {
-    return (node != NULL) ? node->next : NULL;
+    return (node != NULL && node[1].data != NULL) ? node + 1 : NULL;
 }
 
 amf_node_t * 
 amf_array_prev(amf_node_t * node) {
-    return (node != NULL) ? node->prev : NULL;
+    return (node != NULL && node[-1].data != NULL) ? node - 1 : NULL;
 }
 
 amf_data_t * 
@@ -1288,19 +2474,46 @@ amf_array_get_at(const amf_data_t * data, u_int n) {
     return (data != NULL) ? amf_list_get_at(&data->list_data, n) : NULL;
 }
 
+amf_data_t * 
+amf_array_get_mutable(amf_data_t * data, u_int n) {
+    return (amf_data_writable(data) && n < data->list_data.size) ? amf_list_get_mutable(data, &data->list_data.nodes[n + 1]) : NULL;
+}
+
+/* copy the elements as doubles, NaN for those which aren't numbers */
+u_int 
+amf_array_as_doubles(const amf_data_t * data, double * out, u_int max)
+{
+    u_int n, i;
+    const amf_data_t * element;
+
+    if (data == NULL) {
+        return 0;
+    }
+    n = (data->list_data.size < max) ? data->list_data.size : max;
+    for (i = 0; i < n; ++i) {
+        element = data->list_data.nodes[i + 1].data;
+        if (element->type == AMF_TYPE_NUMBER) {
+            memcpy(&out[i], &element->number_data, sizeof(double));
+        } else {
+            out[i] = NAN;
+        }
+    }
+    return n;
+}
+
 amf_data_t * 
 amf_array_delete(amf_data_t * data, amf_node_t * node) {
-    return (data != NULL) ? amf_list_delete(&data->list_data, node) : NULL;
+    return amf_data_resizable(data) ? amf_list_delete(&data->list_data, node) : NULL;
 }
 
 amf_data_t * 
-amf_array_insertfore(amf_data_t * data, amf_node_t * node, amf_data_t * element) {
-    return (data != NULL) ? amf_list_insertfore(&data->list_data, node, element) : NULL;
+amf_array_insert_before(amf_data_t * data, amf_node_t * node, amf_data_t * element) {
+    return amf_data_resizable(data) ? amf_list_insertfore(&data->list_data, node, element) : NULL;
 }
 
 amf_data_t * 
 amf_array_insert_after(amf_data_t * data, amf_node_t * node, amf_data_t * element) {
-    return (data != NULL) ? amf_list_insert_after(&data->list_data, node, element) : NULL;
+    return amf_data_resizable(data) ? amf_list_insert_after(&data->list_data, node, element) : NULL;
 }
 
 
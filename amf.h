@@ -23,6 +23,7 @@ typedef byte amf_type;
 #define AMF_TYPE_END                ((byte)0x09)
 #define AMF_TYPE_ARRAY	            ((byte)0x0A)
 #define AMF_TYPE_DATE	            ((byte)0x0B)
+#define AMF_TYPE_LONG_STRING        ((byte)0x0C)    // not decoded into trees
 /* #define AMF_TYPE_SIMPLEOBJECT	((byte)0x0D) */
 #define AMF_TYPE_XML	            ((byte)0x0F)
 #define AMF_TYPE_CLASS	            ((byte)0x10)
@@ -36,6 +37,9 @@ typedef byte amf_code;
 #define AMF_ERROR_NULL_POINTER      ((byte)0x04)
 #define AMF_ERROR_MEMORY            ((byte)0x05)
 #define AMF_ERROR_UNSUPPORTED_TYPE  ((byte)0x06)
+#define AMF_ERROR_NOT_FOUND         ((byte)0x07)
+#define AMF_ERROR_STOPPED           ((byte)0x08)
+#define AMF_ERROR_LIMIT             ((byte)0x09)
 
 
 
@@ -48,13 +52,35 @@ typedef struct amf_string_s {
     byte           *mbstr;
 } amf_string_t;
 
-/* array type */
+/*
+ * array type, also holding the alternating names and values of objects
+ *
+ * The elements are stored contiguously in nodes[1..size], nodes[0] and nodes[size + 1]
+ * are NULL sentinels which end the walks. Any insertion or deletion may move the nodes:
+ * an amf_node_t pointer is only valid until the list is modified.
+ */
+#define AMF_LIST_MIN_CAPACITY       8
+#define AMF_LIST_MAX_HINT           (64u * 1024)    // cap on the size announced by the stream
+
 typedef struct amf_list_s {
     u_int           size;
-    p_amf_node      first_element;
-    p_amf_node      last_element;
+    u_int           capacity;       // sentinels excluded
+    p_amf_node      nodes;
+    struct amf_hash_s  *hash;       // key index of objects, NULL until needed
+    size_t          encoded;        // sum of the encoded sizes of the elements
+    struct amf_data_s  *parent;     // container holding this one, its size follows
 } amf_list_t;
 
+/*
+ * key index of objects and associative arrays, open addressing over the name nodes
+ *
+ * It is built when an object holding AMF_HASH_MIN_PAIRS pairs is decoded or cloned,
+ * and when adding or deleting a pair brings it there, so lookups never write and may
+ * run concurrently. Other structural changes drop it, lookups scan the pairs then.
+ * The first of duplicate keys wins, as in a scan.
+ */
+#define AMF_HASH_MIN_PAIRS          8
+
 /* date type */
 typedef struct amf_date_s {
     u_int64         milliseconds;
@@ -73,10 +99,29 @@ typedef struct amf_class_s {
     amf_list_t      elements;
 } amf_class_t;
 
+/* AMF data flags */
+#define AMF_DATA_FLAG_ARENA         ((u_byte)0x01)  // allocated from an amf_arena_t
+#define AMF_DATA_FLAG_BORROWED      ((u_byte)0x02)  // string bytes owned by the source buffer
+#define AMF_DATA_FLAG_INTERNED      ((u_byte)0x04)  // key owned by an amf_intern_t
+#define AMF_DATA_FLAG_FROZEN        ((u_byte)0x08)  // in a shared tree, see amf_data_share()
+
+/* reference counts are read and updated atomically with GCC and Clang */
+#if defined(__GNUC__)
+#define amf_data_refs(d)            __atomic_load_n(&(d)->refs, __ATOMIC_ACQUIRE)
+#else
+#define amf_data_refs(d)            ((d)->refs)
+#endif
+
+#define amf_data_is_borrowed(d)     ((d) != NULL && ((d)->flags & AMF_DATA_FLAG_BORROWED))
+/* shared, or inside a shared tree: read-only */
+#define amf_data_is_shared(d)       ((d) != NULL && (amf_data_refs(d) > 0 || ((d)->flags & AMF_DATA_FLAG_FROZEN)))
+
 /* structure encapsulating the various AMF objects */
 typedef struct amf_data_s {
     amf_type        type;
     amf_code        error_code;
+    u_byte          flags;
+    u_int           refs;           // owners besides the first, see amf_data_share()
     union {
         u_int64             number_data;
         u_byte              boolean_data;
@@ -90,18 +135,102 @@ typedef struct amf_data_s {
 
 /* node used in lists, relies on amf_data */
 typedef struct amf_node_s {
-    amf_data_t     *data;
-    p_amf_node      prev;
-    p_amf_node      next;
+    amf_data_t     *data;           // never NULL but in the sentinels
 } amf_node_t;
 
-
+/*
+ * Arena for decoded trees: nodes, strings and lists are carved out of large blocks
+ * and released all at once with amf_arena_reset() or amf_arena_free(), instead of
+ * one free() per node. amf_data_free() is a no-op on arena data. Numbers and booleans
+ * of an arena tree may be set in place, adding, replacing or removing elements is
+ * refused: use amf_data_clone() to get a heap copy.
+ */
+#define AMF_ARENA_DEFAULT_BLOCK_SIZE    (64u * 1024)
+#define AMF_ARENA_ALIGN                 8
+
+typedef struct amf_arena_block_s {
+    struct amf_arena_block_s   *next;
+    size_t                      size;
+    size_t                      used;
+    /* aligned storage follows */
+} amf_arena_block_t;
+
+typedef struct amf_arena_s {
+    amf_arena_block_t  *first;
+    amf_arena_block_t  *current;
+    size_t              block_size;
+} amf_arena_t;
+
+
+
+/*
+ * Growable output buffer for amf_data_encode(). Storage comes from the heap, or from
+ * the arena given to amf_buffer_init(), in which case growing leaves the old storage
+ * to the arena. data is only stable until the next encode.
+ */
+#define AMF_BUFFER_MIN_CAPACITY         256
+
+typedef struct amf_buffer_s {
+    u_byte             *data;
+    size_t              size;
+    size_t              capacity;
+    amf_arena_t        *arena;          // NULL for the heap
+    u_byte              error;          // an allocation failed
+} amf_buffer_t;
+
+
+/*
+ * Intern table of object keys: a key decoded through it is stored once and shared by
+ * every object holding it, amf_data_free() leaves it alone. Two keys of the same table
+ * are equal if and only if they are the same pointer, which is what the object lookups
+ * check first. The table owns its keys and must outlive the trees using them, which
+ * amf_data_clone() copies.
+ *
+ * Only short keys are interned and the table stops growing at AMF_INTERN_MAX_KEYS,
+ * further keys are copied as usual.
+ */
+#define AMF_INTERN_MAX_SIZE             64
+#define AMF_INTERN_MAX_KEYS             4096
+
+typedef struct amf_intern_s {
+    u_int                       count;
+    u_int                       mask;   // slots - 1, 0 until the first key
+    struct amf_intern_key_s   **slots;
+} amf_intern_t;
+
+
+/*
+ * Decoder limits, for untrusted input: nesting of containers, values decoded (keys
+ * excluded) and bytes of the decoded tree (values, string bytes, node arrays), a field
+ * of 0 is unlimited. They are checked before allocating, a decode going past one stops
+ * with AMF_ERROR_LIMIT. Announced array sizes are only reserved while they fit.
+ *
+ * The decoder keeps its own stack, deep nesting doesn't recurse whatever the limits.
+ */
+typedef struct amf_limits_s {
+    u_int           max_depth;
+    u_int           max_elements;
+    size_t          max_bytes;
+} amf_limits_t;
 
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/* intern table functions */
+void            amf_intern_init(amf_intern_t * intern);
+void            amf_intern_free(amf_intern_t * intern);
+/* shared string of a key, NULL past the limits */
+amf_data_t  *   amf_intern(amf_intern_t * intern, const byte * key, u_short size);
+
+/* arena functions */
+void            amf_arena_init(amf_arena_t * arena, size_t block_size);
+void        *   amf_arena_alloc(amf_arena_t * arena, size_t size);
+void            amf_arena_reset(amf_arena_t * arena);
+void            amf_arena_free(amf_arena_t * arena);
+
+
 /* Pluggable backend support */
 typedef size_t (*amf_read_proc)(void * out_buffer, size_t size, void * user_data);
 typedef size_t (*amf_write_proc)(const void * in_buffer, size_t size, void * user_data);
@@ -109,20 +238,49 @@ typedef size_t (*amf_write_proc)(const void * in_buffer, size_t size, void * use
 
 /* read AMF data */
 amf_data_t  *   amf_data_read(amf_read_proc read_proc, void * user_data);
+/* read AMF data, every allocation is made from the arena */
+amf_data_t  *   amf_data_read_arena(amf_read_proc read_proc, void * user_data, amf_arena_t * arena);
+/* read AMF data within limits, arena may be NULL */
+amf_data_t  *   amf_data_read_limited(amf_read_proc read_proc, void * user_data, amf_arena_t * arena, const amf_limits_t * limits);
 
 /* write AMF data */
 size_t          amf_data_write(const amf_data_t * data, amf_write_proc write_proc, void * user_data);
 
 
+/* growable output buffer functions */
+void            amf_buffer_init(amf_buffer_t * buffer, amf_arena_t * arena);
+void            amf_buffer_free(amf_buffer_t * buffer);
+#define amf_buffer_reset(b)     ((b)->size = 0, (b)->error = 0)
+/* room for n more bytes at data + size, NULL when out of memory; the caller moves size */
+u_byte      *   amf_buffer_reserve(amf_buffer_t * buffer, size_t n);
+/* append the encoding of AMF data in one pass, returns its size, 0 when out of memory */
+size_t          amf_data_encode(const amf_data_t * data, amf_buffer_t * buffer);
+
+
 /* generic functions */
 
 /* allocate an AMF data object */
 amf_data_t  *   amf_data_new(byte type);
 /* load AMF data from buffer */
 amf_data_t  *   amf_data_buffer_read(byte * buffer, size_t maxbytes);
+/* load AMF data from buffer into an arena */
+amf_data_t  *   amf_data_buffer_read_arena(byte * buffer, size_t maxbytes, amf_arena_t * arena);
+/*
+ * load AMF data from buffer without copying strings, arena may be NULL
+ *
+ * The strings borrow their bytes from the buffer: they are valid as long as the buffer
+ * is, and are not NUL terminated (use amf_string_get_size()). amf_data_clone() returns
+ * a tree owning its strings.
+ */
+amf_data_t  *   amf_data_buffer_read_view(byte * buffer, size_t maxbytes, amf_arena_t * arena);
+/* load AMF data from buffer with object keys taken from an intern table, arena may be NULL */
+amf_data_t  *   amf_data_buffer_read_interned(byte * buffer, size_t maxbytes, amf_arena_t * arena, amf_intern_t * intern);
+/* load AMF data from buffer within limits, arena may be NULL */
+amf_data_t  *   amf_data_buffer_read_limited(byte * buffer, size_t maxbytes, amf_arena_t * arena, const amf_limits_t * limits);
 /* load AMF data from stream */
 amf_data_t  *   amf_data_file_read(FILE * stream);
-/* AMF data size */
+amf_data_t  *   amf_data_file_read_limited(FILE * stream, const amf_limits_t * limits);
+/* AMF data size, O(1): containers keep it up to date */
 size_t          amf_data_size(const amf_data_t * data);
 /* write encoded AMF data into a buffer */
 size_t          amf_data_buffer_write(amf_data_t * data, byte * buffer, size_t maxbytes);
@@ -132,14 +290,42 @@ size_t          amf_data_file_write(const amf_data_t * data, FILE * stream);
 byte            amf_data_get_type(const amf_data_t * data);
 /* get the error code of AMF data */
 byte            amf_data_get_error_code(const amf_data_t * data);
-/* return a new copy of AMF data */
+/* return a new copy of AMF data on the heap, interned keys included */
 amf_data_t  *   amf_data_clone(const amf_data_t * data);
+/*
+ * Shared values: amf_data_share() hands a heap value to one more owner, each owner
+ * releases it with amf_data_free(). A shared value is read-only down to its leaves:
+ * the first share marks the whole tree frozen (one walk, the next shares are O(1)),
+ * and the functions modifying a frozen value fail or do nothing, whatever getter it
+ * was reached with.
+ *
+ * amf_data_unshare() is the copy on write: it gives the value back as is to its last
+ * owner, otherwise it drops the caller's share and returns a copy of the top level
+ * which shares the elements. Nested values are made writable on the way down, from a
+ * writable container, with amf_object_get_mutable() and amf_array_get_mutable(): an
+ * element held by that container only is thawed in place, another one is copied, and
+ * either is linked to the container so that the encoded sizes above it stay right.
+ *
+ * Owners may share, unshare and free one value from several threads: the count is
+ * updated atomically (elsewhere than GCC and Clang, the caller serializes these calls).
+ * The first share writes the frozen marks and must happen before the value reaches
+ * other threads; reading a shared tree takes no lock.
+ *
+ * Arena values are copied to the heap by amf_data_share(), interned keys are immutable
+ * and shared as they are.
+ */
+amf_data_t  *   amf_data_share(amf_data_t * data);
+amf_data_t  *   amf_data_unshare(amf_data_t * data);
 /* release the memory of AMF data */
 void            amf_data_free(amf_data_t * data);
 /* dump AMF data into a stream as text */
 void            amf_data_dump(FILE * stream, const amf_data_t * data, int indent_level);
 
 
+/* decode the leading run of encoded number entries (marker and double) of a buffer */
+u_int           amf_numbers_decode(const void * buffer, size_t size, double * out, u_int max);
+
+
 /* return a null AMF object with the specified error code attached to it */
 amf_data_t  *   amf_data_error(byte error_code);
 
@@ -148,6 +334,9 @@ amf_data_t  *   amf_data_error(byte error_code);
 amf_data_t  *   amf_number_new(u_int64 value);
 u_int64         amf_number_get_value(const amf_data_t * data);
 void            amf_number_set_value(amf_data_t * data, u_int64 value);
+amf_data_t  *   amf_number_new_double(double value);
+double          amf_number_get_double(const amf_data_t * data);
+void            amf_number_set_double(amf_data_t * data, double value);
 
 
 /* boolean functions */
@@ -168,7 +357,11 @@ amf_data_t  *   amf_object_new(void);
 u_int           amf_object_size(const amf_data_t * data);
 amf_data_t  *   amf_object_add(amf_data_t * data, const char * name, amf_data_t * element);
 amf_data_t  *   amf_object_get(const amf_data_t * data, const char * name);
+/* lookup by a key string, by pointer for a key interned by the table of the object keys */
+amf_data_t  *   amf_object_get_key(const amf_data_t * data, const amf_data_t * key);
 amf_data_t  *   amf_object_set(amf_data_t * data, const char * name, amf_data_t * element);
+/* the value of a key made writable, data must be writable */
+amf_data_t  *   amf_object_get_mutable(amf_data_t * data, const char * name);
 amf_data_t  *   amf_object_delete(amf_data_t * data, const char * name);
 amf_node_t  *   amf_object_first(const amf_data_t * data);
 amf_node_t  *   amf_object_last(const amf_data_t * data);
@@ -210,7 +403,11 @@ amf_node_t  *   amf_array_last(const amf_data_t * data);
 amf_node_t  *   amf_array_next(amf_node_t * node);
 amf_node_t  *   amf_array_prev(amf_node_t * node);
 amf_data_t  *   amf_array_get(amf_node_t * node);
-amf_data_t  *   amf_array_get_at(const amf_data_t * data, u_int n);
+amf_data_t  *   amf_array_get_at(const amf_data_t * data, u_int n);      /* O(1) */
+/* the element at n made writable, data must be writable */
+amf_data_t  *   amf_array_get_mutable(amf_data_t * data, u_int n);
+/* copy up to max elements into out, NaN for non numbers, returns the count copied */
+u_int           amf_array_as_doubles(const amf_data_t * data, double * out, u_int max);
 amf_data_t  *   amf_array_delete(amf_data_t * data, amf_node_t * node);
 amf_data_t  *   amf_array_insert_before(amf_data_t * data, amf_node_t * node, amf_data_t * element);
 amf_data_t  *   amf_array_insert_after(amf_data_t * data, amf_node_t * node, amf_data_t * element);
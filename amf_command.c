@@ -0,0 +1,463 @@
+#include "amf_command.h"
+
+#include <string.h>
+#include <stddef.h>
+
+
+typedef struct amf_command_name_s {
+    const char *name;
+    u_short     size;
+} amf_command_name_t;
+
+#define AMF_COMMAND_NAME(name)  { name, sizeof(name) - 1 }
+
+/* indexed by AMF_COMMAND_* */
+static const amf_command_name_t amf_command_names[] = {
+    { NULL, 0 },
+    AMF_COMMAND_NAME("connect"),
+    AMF_COMMAND_NAME("createStream"),
+    AMF_COMMAND_NAME("publish"),
+    AMF_COMMAND_NAME("play"),
+    AMF_COMMAND_NAME("_result"),
+    AMF_COMMAND_NAME("_error"),
+    AMF_COMMAND_NAME("onStatus"),
+};
+
+#define AMF_COMMAND_COUNT   (sizeof(amf_command_names) / sizeof(amf_command_names[0]))
+
+
+/* object keys, stored at offset in the command with the given type */
+typedef struct amf_command_key_s {
+    const char *name;
+    u_short     size;
+    amf_type    type;
+    u_int       field;
+    size_t      offset;
+} amf_command_key_t;
+
+#define AMF_COMMAND_KEY(name, type, field, member) \
+    { name, sizeof(name) - 1, type, field, offsetof(amf_command_t, member) }
+
+static const amf_command_key_t amf_connect_keys[] = {
+    AMF_COMMAND_KEY("app",            AMF_TYPE_STRING,  AMF_CONNECT_APP,             connect.app),
+    AMF_COMMAND_KEY("flashVer",       AMF_TYPE_STRING,  AMF_CONNECT_FLASH_VER,       connect.flash_ver),
+    AMF_COMMAND_KEY("swfUrl",         AMF_TYPE_STRING,  AMF_CONNECT_SWF_URL,         connect.swf_url),
+    AMF_COMMAND_KEY("tcUrl",          AMF_TYPE_STRING,  AMF_CONNECT_TC_URL,          connect.tc_url),
+    AMF_COMMAND_KEY("fpad",           AMF_TYPE_BOOLEAN, AMF_CONNECT_FPAD,            connect.fpad),
+    AMF_COMMAND_KEY("capabilities",   AMF_TYPE_NUMBER,  AMF_CONNECT_CAPABILITIES,    connect.capabilities),
+    AMF_COMMAND_KEY("audioCodecs",    AMF_TYPE_NUMBER,  AMF_CONNECT_AUDIO_CODECS,    connect.audio_codecs),
+    AMF_COMMAND_KEY("videoCodecs",    AMF_TYPE_NUMBER,  AMF_CONNECT_VIDEO_CODECS,    connect.video_codecs),
+    AMF_COMMAND_KEY("videoFunction",  AMF_TYPE_NUMBER,  AMF_CONNECT_VIDEO_FUNCTION,  connect.video_function),
+    AMF_COMMAND_KEY("pageUrl",        AMF_TYPE_STRING,  AMF_CONNECT_PAGE_URL,        connect.page_url),
+    AMF_COMMAND_KEY("objectEncoding", AMF_TYPE_NUMBER,  AMF_CONNECT_OBJECT_ENCODING, connect.object_encoding),
+    { NULL, 0, 0, 0, 0 }
+};
+
+static const amf_command_key_t amf_status_properties[] = {
+    AMF_COMMAND_KEY("fmsVer",         AMF_TYPE_STRING,  AMF_STATUS_FMS_VER,          status.fms_ver),
+    AMF_COMMAND_KEY("capabilities",   AMF_TYPE_NUMBER,  AMF_STATUS_CAPABILITIES,     status.capabilities),
+    AMF_COMMAND_KEY("mode",           AMF_TYPE_NUMBER,  AMF_STATUS_MODE,             status.mode),
+    { NULL, 0, 0, 0, 0 }
+};
+
+static const amf_command_key_t amf_status_information[] = {
+    AMF_COMMAND_KEY("level",          AMF_TYPE_STRING,  AMF_STATUS_LEVEL,            status.level),
+    AMF_COMMAND_KEY("code",           AMF_TYPE_STRING,  AMF_STATUS_CODE,             status.code),
+    AMF_COMMAND_KEY("description",    AMF_TYPE_STRING,  AMF_STATUS_DESCRIPTION,      status.description),
+    AMF_COMMAND_KEY("objectEncoding", AMF_TYPE_NUMBER,  AMF_STATUS_OBJECT_ENCODING,  status.object_encoding),
+    { NULL, 0, 0, 0, 0 }
+};
+
+#define AMF_STATUS_PROPERTIES   (AMF_STATUS_FMS_VER | AMF_STATUS_MODE | AMF_STATUS_CAPABILITIES)
+#define AMF_STATUS_INFORMATION  (AMF_STATUS_LEVEL | AMF_STATUS_CODE | AMF_STATUS_DESCRIPTION | AMF_STATUS_OBJECT_ENCODING)
+
+#define amf_command_member(command, key, type)  ((type*) ((byte*) (command) + (key)->offset))
+
+
+void
+amf_command_init(amf_command_t * command, u_int type, double transaction_id)
+{
+    memset(command, 0, sizeof(amf_command_t));
+    command->type = type;
+    command->transaction_id = transaction_id;
+    if (type == AMF_COMMAND_PLAY) {
+        command->play.start = -2;
+        command->play.duration = -1;
+        command->play.reset = 1;
+    }
+}
+
+
+/* decoding */
+
+#define amf_command_is_null(view) \
+    ((view)->type == AMF_TYPE_NULL || (view)->type == AMF_TYPE_UNDEFINED)
+
+/* long strings are read as strings */
+#define amf_command_view_type(view) \
+    (((view)->type == AMF_TYPE_LONG_STRING) ? AMF_TYPE_STRING : (view)->type)
+
+
+static void
+amf_command_store(amf_command_t * command, const amf_command_key_t * key, const amf_view_t * view)
+{
+    amf_bytes_t * bytes;
+
+    switch (key->type) {
+        case AMF_TYPE_NUMBER:
+            *amf_command_member(command, key, double) = view->number;
+            break;
+        case AMF_TYPE_BOOLEAN:
+            *amf_command_member(command, key, u_byte) = view->boolean;
+            break;
+        default:
+            bytes = amf_command_member(command, key, amf_bytes_t);
+            bytes->bytes = view->string.bytes;
+            bytes->size = view->string.size;
+            break;
+    }
+    command->fields |= key->field;
+}
+
+
+/* the known keys of an object or associative array, null stands for an empty one */
+static amf_code
+amf_command_read_object(amf_command_t * command, const amf_view_t * object, const amf_command_key_t * keys)
+{
+    const amf_command_key_t * key;
+    amf_cursor_t cursor;
+    amf_view_t view;
+    amf_code e;
+
+    if (amf_command_is_null(object)) {
+        return AMF_ERROR_OK;
+    }
+    if ((e = amf_cursor_enter(&cursor, object)) != AMF_ERROR_OK) {
+        return AMF_ERROR_UNSUPPORTED_TYPE;
+    }
+    while ((e = amf_cursor_next(&cursor, &view)) == AMF_ERROR_OK) {
+        for (key = keys; key->name != NULL; ++key) {
+            if (key->size == view.key_size && key->type == amf_command_view_type(&view) && memcmp(key->name, view.key, key->size) == 0) {
+                amf_command_store(command, key, &view);
+                break;
+            }
+        }
+    }
+    return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_OK : e;
+}
+
+
+/* the next argument which must be there */
+static amf_code
+amf_command_arg(amf_cursor_t * cursor, amf_view_t * view)
+{
+    amf_code e = amf_cursor_next(cursor, view);
+    return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_EOF : e;
+}
+
+
+static amf_code
+amf_command_read_string(amf_cursor_t * cursor, amf_bytes_t * bytes)
+{
+    amf_view_t view;
+    amf_code e;
+
+    if ((e = amf_command_arg(cursor, &view)) != AMF_ERROR_OK) {
+        return e;
+    }
+    if (amf_command_view_type(&view) != AMF_TYPE_STRING) {
+        return AMF_ERROR_UNSUPPORTED_TYPE;
+    }
+    bytes->bytes = view.string.bytes;
+    bytes->size = view.string.size;
+    return AMF_ERROR_OK;
+}
+
+
+/* start, duration and reset may be left out, from the last one */
+static amf_code
+amf_command_read_play(amf_command_t * command, amf_cursor_t * cursor)
+{
+    amf_view_t view;
+    amf_code e;
+
+    if ((e = amf_cursor_next(cursor, &view)) != AMF_ERROR_OK || view.type != AMF_TYPE_NUMBER) {
+        return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_OK : e;
+    }
+    command->play.start = view.number;
+    command->fields |= AMF_PLAY_START;
+
+    if ((e = amf_cursor_next(cursor, &view)) != AMF_ERROR_OK || view.type != AMF_TYPE_NUMBER) {
+        return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_OK : e;
+    }
+    command->play.duration = view.number;
+    command->fields |= AMF_PLAY_DURATION;
+
+    if ((e = amf_cursor_next(cursor, &view)) != AMF_ERROR_OK) {
+        return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_OK : e;
+    }
+    if (view.type == AMF_TYPE_BOOLEAN) {
+        command->play.reset = view.boolean;
+        command->fields |= AMF_PLAY_RESET;
+    } else if (view.type == AMF_TYPE_NUMBER) {
+        command->play.reset = (view.number != 0);
+        command->fields |= AMF_PLAY_RESET;
+    }
+    return AMF_ERROR_OK;
+}
+
+
+/* properties or null, then information or a stream id */
+static amf_code
+amf_command_read_status(amf_command_t * command, amf_cursor_t * cursor)
+{
+    amf_view_t view;
+    amf_code e;
+
+    if ((e = amf_cursor_next(cursor, &view)) != AMF_ERROR_OK) {
+        return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_OK : e;
+    }
+    if ((e = amf_command_read_object(command, &view, amf_status_properties)) != AMF_ERROR_OK) {
+        return e;
+    }
+
+    if ((e = amf_cursor_next(cursor, &view)) != AMF_ERROR_OK) {
+        return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_OK : e;
+    }
+    if (view.type == AMF_TYPE_NUMBER) {
+        command->status.stream_id = view.number;
+        command->fields |= AMF_STATUS_STREAM_ID;
+        return AMF_ERROR_OK;
+    }
+    return amf_command_read_object(command, &view, amf_status_information);
+}
+
+
+amf_code
+amf_command_decode(amf_command_t * command, const void * body, size_t size)
+{
+    amf_cursor_t cursor;
+    amf_view_t view;
+    u_int type;
+    amf_code e;
+
+    /* command name, transaction id */
+    amf_cursor_init(&cursor, body, size);
+    if ((e = amf_command_arg(&cursor, &view)) != AMF_ERROR_OK) {
+        return e;
+    }
+    if (view.type != AMF_TYPE_STRING) {
+        return AMF_ERROR_UNSUPPORTED_TYPE;
+    }
+    for (type = AMF_COMMAND_COUNT - 1; type > AMF_COMMAND_UNKNOWN; --type) {
+        if (amf_command_names[type].size == view.string.size
+        &&  memcmp(amf_command_names[type].name, view.string.bytes, view.string.size) == 0)
+        {
+            break;
+        }
+    }
+    amf_command_init(command, type, 0);
+    command->name.bytes = view.string.bytes;
+    command->name.size = view.string.size;
+
+    if ((e = amf_command_arg(&cursor, &view)) != AMF_ERROR_OK) {
+        return e;
+    }
+    if (view.type != AMF_TYPE_NUMBER) {
+        return AMF_ERROR_UNSUPPORTED_TYPE;
+    }
+    command->transaction_id = view.number;
+
+    switch (type) {
+        case AMF_COMMAND_CONNECT:
+            if ((e = amf_command_arg(&cursor, &view)) != AMF_ERROR_OK) {
+                return e;
+            }
+            return amf_command_read_object(command, &view, amf_connect_keys);
+        case AMF_COMMAND_CREATE_STREAM:
+            return AMF_ERROR_OK;
+        case AMF_COMMAND_PUBLISH:
+            /* the command object is null, the publishing type may be left out */
+            if ((e = amf_command_arg(&cursor, &view)) != AMF_ERROR_OK
+            ||  (e = amf_command_read_string(&cursor, &command->publish.stream_name)) != AMF_ERROR_OK)
+            {
+                return e;
+            }
+            e = amf_command_read_string(&cursor, &command->publish.type);
+            return (e == AMF_ERROR_EOF) ? AMF_ERROR_OK : e;
+        case AMF_COMMAND_PLAY:
+            if ((e = amf_command_arg(&cursor, &view)) != AMF_ERROR_OK
+            ||  (e = amf_command_read_string(&cursor, &command->play.stream_name)) != AMF_ERROR_OK)
+            {
+                return e;
+            }
+            return amf_command_read_play(command, &cursor);
+        case AMF_COMMAND_RESULT:
+        case AMF_COMMAND_ERROR:
+        case AMF_COMMAND_ON_STATUS:
+            return amf_command_read_status(command, &cursor);
+        default:
+            return AMF_ERROR_NOT_FOUND;
+    }
+}
+
+
+/* encoding */
+
+static void
+amf_command_put_number(amf_buffer_t * buffer, double value)
+{
+    u_byte * p = amf_buffer_reserve(buffer, 9);
+    u_int64 bits;
+
+    if (p != NULL) {
+        memcpy(&bits, &value, sizeof(double));
+        p[0] = AMF_TYPE_NUMBER;
+        store_u_int32_be(p + 1, (u_int) (bits >> 32));
+        store_u_int32_be(p + 5, (u_int) bits);
+        buffer->size += 9;
+    }
+}
+
+
+/* a one byte value after its type marker */
+static void
+amf_command_put_byte(amf_buffer_t * buffer, amf_type type, u_byte value)
+{
+    u_byte * p = amf_buffer_reserve(buffer, 2);
+
+    if (p != NULL) {
+        p[0] = type;
+        p[1] = value;
+        buffer->size += (type == AMF_TYPE_BOOLEAN) ? 2 : 1;
+    }
+}
+
+#define amf_command_put_null(buffer)            amf_command_put_byte((buffer), AMF_TYPE_NULL, 0)
+#define amf_command_put_boolean(buffer, value)  amf_command_put_byte((buffer), AMF_TYPE_BOOLEAN, (value) != 0)
+
+
+/* object key, or string value with its marker; long strings past 64KB */
+static void
+amf_command_put_bytes(amf_buffer_t * buffer, const byte * bytes, u_int size, int marker)
+{
+    u_byte * p = amf_buffer_reserve(buffer, (size_t) 5 + size);
+
+    if (p == NULL) {
+        return;
+    }
+    if (!marker) {
+        store_u_int16_be(p, (u_short) size);
+        p += 2;
+    } else if (size <= 0xFFFF) {
+        *p++ = AMF_TYPE_STRING;
+        store_u_int16_be(p, (u_short) size);
+        p += 2;
+    } else {
+        *p++ = AMF_TYPE_LONG_STRING;
+        store_u_int32_be(p, size);
+        p += 4;
+    }
+    if (size > 0) {
+        memcpy(p, bytes, size);
+    }
+    buffer->size = (size_t) (p + size - buffer->data);
+}
+
+#define amf_command_put_string(buffer, b)   amf_command_put_bytes((buffer), (b)->bytes, (b)->size, 1)
+
+
+/* the keys of the table found in fields */
+static void
+amf_command_put_object(amf_buffer_t * buffer, const amf_command_t * command, const amf_command_key_t * keys)
+{
+    const amf_command_key_t * key;
+    u_byte * p;
+
+    if ((p = amf_buffer_reserve(buffer, 1)) != NULL) {
+        *p = AMF_TYPE_OBJECT;
+        ++(buffer->size);
+    }
+    for (key = keys; key->name != NULL; ++key) {
+        if (!(command->fields & key->field)) {
+            continue;
+        }
+        amf_command_put_bytes(buffer, key->name, key->size, 0);
+        switch (key->type) {
+            case AMF_TYPE_NUMBER:
+                amf_command_put_number(buffer, *amf_command_member(command, key, const double));
+                break;
+            case AMF_TYPE_BOOLEAN:
+                amf_command_put_boolean(buffer, *amf_command_member(command, key, const u_byte));
+                break;
+            default:
+                amf_command_put_string(buffer, amf_command_member(command, key, const amf_bytes_t));
+                break;
+        }
+    }
+    if ((p = amf_buffer_reserve(buffer, 3)) != NULL) {
+        store_u_int24_be(p, AMF_TYPE_END);
+        buffer->size += 3;
+    }
+}
+
+
+size_t
+amf_command_encode(const amf_command_t * command, amf_buffer_t * buffer)
+{
+    const amf_command_name_t * name;
+    size_t start = buffer->size;
+
+    if (command->type == AMF_COMMAND_UNKNOWN || command->type >= AMF_COMMAND_COUNT) {
+        return 0;
+    }
+    name = &amf_command_names[command->type];
+    amf_command_put_bytes(buffer, name->name, name->size, 1);
+    amf_command_put_number(buffer, command->transaction_id);
+
+    switch (command->type) {
+        case AMF_COMMAND_CONNECT:
+            amf_command_put_object(buffer, command, amf_connect_keys);
+            break;
+        case AMF_COMMAND_CREATE_STREAM:
+            amf_command_put_null(buffer);
+            break;
+        case AMF_COMMAND_PUBLISH:
+            amf_command_put_null(buffer);
+            amf_command_put_string(buffer, &command->publish.stream_name);
+            amf_command_put_string(buffer, &command->publish.type);
+            break;
+        case AMF_COMMAND_PLAY:
+            /* arguments are positional, up to the last one given */
+            amf_command_put_null(buffer);
+            amf_command_put_string(buffer, &command->play.stream_name);
+            if (command->fields & (AMF_PLAY_START | AMF_PLAY_DURATION | AMF_PLAY_RESET)) {
+                amf_command_put_number(buffer, command->play.start);
+            }
+            if (command->fields & (AMF_PLAY_DURATION | AMF_PLAY_RESET)) {
+                amf_command_put_number(buffer, command->play.duration);
+            }
+            if (command->fields & AMF_PLAY_RESET) {
+                amf_command_put_boolean(buffer, command->play.reset);
+            }
+            break;
+        default:
+            if (command->fields & AMF_STATUS_PROPERTIES) {
+                amf_command_put_object(buffer, command, amf_status_properties);
+            } else {
+                amf_command_put_null(buffer);
+            }
+            if (command->fields & AMF_STATUS_STREAM_ID) {
+                amf_command_put_number(buffer, command->status.stream_id);
+            } else if (command->fields & AMF_STATUS_INFORMATION) {
+                amf_command_put_object(buffer, command, amf_status_information);
+            }
+            break;
+    }
+
+    if (buffer->error) {
+        buffer->size = start;
+        return 0;
+    }
+    return buffer->size - start;
+}
@@ -0,0 +1,144 @@
+#ifndef __AMF_COMMAND_H__
+#define __AMF_COMMAND_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "amf.h"
+#include "amf_cursor.h"
+
+
+
+
+/*
+ * Typed codec for the RTMP AMF0 commands: connect, createStream, publish, play and the
+ * _result / _error / onStatus replies. The body of a command message is decoded with a
+ * cursor into a fixed struct, and encoded straight into a reusable amf_buffer_t. No AMF
+ * tree is built, nothing is allocated once the buffer has grown.
+ *
+ * Decoded strings borrow their bytes from the message and are valid as long as it is;
+ * strings to encode are borrowed the same way. fields tells which of the optional
+ * values were found, and which are written: object keys outside the tables below and
+ * extra arguments are skipped when decoding.
+ *
+ *   connect       transaction id, command object (AMF_CONNECT_* keys)
+ *   createStream  transaction id, null
+ *   publish       transaction id, null, stream name, publishing type
+ *   play          transaction id, null, stream name, [start, [duration, [reset]]]
+ *   _result,      transaction id, properties object (AMF_STATUS_FMS_VER to CAPABILITIES)
+ *   _error,         or null, information object (AMF_STATUS_LEVEL to OBJECT_ENCODING)
+ *   onStatus        or the stream id number of a createStream _result
+ */
+
+#define AMF_COMMAND_UNKNOWN         0
+#define AMF_COMMAND_CONNECT         1
+#define AMF_COMMAND_CREATE_STREAM   2
+#define AMF_COMMAND_PUBLISH         3
+#define AMF_COMMAND_PLAY            4
+#define AMF_COMMAND_RESULT          5
+#define AMF_COMMAND_ERROR           6
+#define AMF_COMMAND_ON_STATUS       7
+
+/* connect command object */
+#define AMF_CONNECT_APP             0x0001
+#define AMF_CONNECT_FLASH_VER       0x0002
+#define AMF_CONNECT_SWF_URL         0x0004
+#define AMF_CONNECT_TC_URL          0x0008
+#define AMF_CONNECT_FPAD            0x0010
+#define AMF_CONNECT_CAPABILITIES    0x0020
+#define AMF_CONNECT_AUDIO_CODECS    0x0040
+#define AMF_CONNECT_VIDEO_CODECS    0x0080
+#define AMF_CONNECT_VIDEO_FUNCTION  0x0100
+#define AMF_CONNECT_PAGE_URL        0x0200
+#define AMF_CONNECT_OBJECT_ENCODING 0x0400
+
+/* play arguments, the ones missing keep their defaults: -2, -1, true */
+#define AMF_PLAY_START              0x0001
+#define AMF_PLAY_DURATION           0x0002
+#define AMF_PLAY_RESET              0x0004
+
+/* _result, _error and onStatus */
+#define AMF_STATUS_FMS_VER          0x0001
+#define AMF_STATUS_MODE             0x0002
+#define AMF_STATUS_CAPABILITIES     0x0004
+#define AMF_STATUS_LEVEL            0x0008
+#define AMF_STATUS_CODE             0x0010
+#define AMF_STATUS_DESCRIPTION      0x0020
+#define AMF_STATUS_OBJECT_ENCODING  0x0040
+#define AMF_STATUS_STREAM_ID        0x0080
+
+typedef struct amf_bytes_s {
+    const byte     *bytes;          // not NUL terminated, NULL when missing
+    u_int           size;
+} amf_bytes_t;
+
+typedef struct amf_connect_s {
+    amf_bytes_t     app;
+    amf_bytes_t     flash_ver;
+    amf_bytes_t     swf_url;
+    amf_bytes_t     tc_url;
+    amf_bytes_t     page_url;
+    u_byte          fpad;
+    double          capabilities;
+    double          audio_codecs;
+    double          video_codecs;
+    double          video_function;
+    double          object_encoding;
+} amf_connect_t;
+
+typedef struct amf_publish_s {
+    amf_bytes_t     stream_name;
+    amf_bytes_t     type;           // "live", "record" or "append"
+} amf_publish_t;
+
+typedef struct amf_play_s {
+    amf_bytes_t     stream_name;
+    double          start;
+    double          duration;
+    u_byte          reset;
+} amf_play_t;
+
+typedef struct amf_status_s {
+    amf_bytes_t     fms_ver;
+    double          mode;
+    double          capabilities;
+    amf_bytes_t     level;          // "status", "error" or "warning"
+    amf_bytes_t     code;           // "NetConnection.Connect.Success"...
+    amf_bytes_t     description;
+    double          object_encoding;
+    double          stream_id;
+} amf_status_t;
+
+typedef struct amf_command_s {
+    u_int           type;           // AMF_COMMAND_*
+    amf_bytes_t     name;           // as found, ignored when encoding a known type
+    double          transaction_id;
+    u_int           fields;         // AMF_CONNECT_*, AMF_PLAY_* or AMF_STATUS_* of the type
+    union {
+        amf_connect_t   connect;
+        amf_publish_t   publish;
+        amf_play_t      play;
+        amf_status_t    status;     // _result, _error and onStatus
+    };
+} amf_command_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* clear a command of the given type, play arguments take their defaults */
+void        amf_command_init(amf_command_t * command, u_int type, double transaction_id);
+/* decode a command message body, AMF_ERROR_NOT_FOUND for another command (name is set) */
+amf_code    amf_command_decode(amf_command_t * command, const void * body, size_t size);
+/* append the encoded command, returns its size, 0 when out of memory or for an unknown type */
+size_t      amf_command_encode(const amf_command_t * command, amf_buffer_t * buffer);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __AMF_COMMAND_H__ */
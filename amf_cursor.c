@@ -0,0 +1,389 @@
+#include "amf_cursor.h"
+
+#include <math.h>
+
+
+/* AMF0 markers the tree decoder doesn't support, still skipped by the cursor */
+#define AMF_CURSOR_TYPE_REFERENCE       ((byte)0x07)
+#define AMF_CURSOR_TYPE_UNSUPPORTED     ((byte)0x0D)
+
+
+static amf_code amf_cursor_skip_value(const u_byte ** p, const u_byte * end, u_int depth);
+
+
+/* skip key / value pairs up to the empty key ending them */
+static amf_code
+amf_cursor_skip_pairs(const u_byte ** p, const u_byte * end, u_int depth)
+{
+    u_short size;
+    amf_code e;
+
+    while (1) {
+        if (end - *p < 2) {
+            return AMF_ERROR_EOF;
+        }
+        size = load_u_int16_be(*p);
+        *p += 2;
+        if (size == 0) {
+            if (*p < end && **p == AMF_TYPE_END) {
+                ++(*p);
+            }
+            return AMF_ERROR_OK;
+        }
+        if (end - *p < size) {
+            return AMF_ERROR_EOF;
+        }
+        *p += size;
+
+        e = amf_cursor_skip_value(p, end, depth);
+        if (e == AMF_ERROR_END_TAG) {
+            return AMF_ERROR_OK;    /* unnamed terminator, as amf_data_read() accepts */
+        }
+        if (e != AMF_ERROR_OK) {
+            return e;
+        }
+    }
+}
+
+
+/* skip a whole value, type marker included */
+static amf_code
+amf_cursor_skip_value(const u_byte ** p, const u_byte * end, u_int depth)
+{
+    amf_type type;
+    u_int count;
+    amf_code e;
+
+    if (*p >= end) {
+        return AMF_ERROR_EOF;
+    }
+    if (depth >= AMF_CURSOR_MAX_DEPTH) {
+        return AMF_ERROR_UNSUPPORTED_TYPE;
+    }
+    type = (amf_type) *((*p)++);
+
+#define amf_cursor_need(n)  do { if ((size_t) (end - *p) < (size_t) (n)) return AMF_ERROR_EOF; } while (0)
+
+    switch (type) {
+        case AMF_TYPE_NUMBER:
+            amf_cursor_need(8);
+            *p += 8;
+            return AMF_ERROR_OK;
+        case AMF_TYPE_BOOLEAN:
+            amf_cursor_need(1);
+            *p += 1;
+            return AMF_ERROR_OK;
+        case AMF_TYPE_STRING:
+            amf_cursor_need(2);
+            count = load_u_int16_be(*p);
+            amf_cursor_need(2 + count);
+            *p += 2 + count;
+            return AMF_ERROR_OK;
+        case AMF_TYPE_LONG_STRING:
+        case AMF_TYPE_XML:
+            amf_cursor_need(4);
+            count = load_u_int32_be(*p);
+            amf_cursor_need((size_t) 4 + count);
+            *p += (size_t) 4 + count;
+            return AMF_ERROR_OK;
+        case AMF_TYPE_OBJECT:
+            return amf_cursor_skip_pairs(p, end, depth + 1);
+        case AMF_TYPE_CLASS:
+            amf_cursor_need(2);
+            count = load_u_int16_be(*p);
+            amf_cursor_need(2 + count);
+            *p += 2 + count;
+            return amf_cursor_skip_pairs(p, end, depth + 1);
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+            amf_cursor_need(4);
+            *p += 4;
+            return amf_cursor_skip_pairs(p, end, depth + 1);
+        case AMF_TYPE_ARRAY:
+            amf_cursor_need(4);
+            count = load_u_int32_be(*p);
+            *p += 4;
+            /* every element takes at least a byte, a bogus count runs into the end */
+            while (count-- > 0) {
+                if ((e = amf_cursor_skip_value(p, end, depth + 1)) != AMF_ERROR_OK) {
+                    return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_EOF : e;
+                }
+            }
+            return AMF_ERROR_OK;
+        case AMF_TYPE_DATE:
+            amf_cursor_need(10);
+            *p += 10;
+            return AMF_ERROR_OK;
+        case AMF_CURSOR_TYPE_REFERENCE:
+            amf_cursor_need(2);
+            *p += 2;
+            return AMF_ERROR_OK;
+        case AMF_TYPE_NULL:
+        case AMF_TYPE_UNDEFINED:
+        case AMF_CURSOR_TYPE_UNSUPPORTED:
+            return AMF_ERROR_OK;
+        case AMF_TYPE_END:
+            return AMF_ERROR_END_TAG;
+        default:
+            return AMF_ERROR_UNKNOWN_TYPE;
+    }
+
+#undef amf_cursor_need
+}
+
+
+void
+amf_cursor_init(amf_cursor_t * cursor, const void * buffer, size_t size)
+{
+    cursor->pos = (const u_byte *) buffer;
+    cursor->end = cursor->pos + size;
+    cursor->container = AMF_TYPE_END;
+    cursor->remaining = 0;
+}
+
+
+/* the view of the value at p, p has already been checked by a skip up to end */
+static void
+amf_cursor_decode(amf_view_t * view, const u_byte * p, const u_byte * end)
+{
+    u_int64 bits;
+
+    view->type = (amf_type) p[0];
+    view->start = p;
+    view->size = (size_t) (end - p);
+
+    switch (view->type) {
+        case AMF_TYPE_NUMBER:
+            bits = load_u_int64_be(p + 1);
+            memcpy(&view->number, &bits, sizeof(double));
+            break;
+        case AMF_TYPE_BOOLEAN:
+            view->boolean = p[1];
+            break;
+        case AMF_TYPE_STRING:
+            view->string.size = load_u_int16_be(p + 1);
+            view->string.bytes = (const byte *) p + 3;
+            break;
+        case AMF_TYPE_LONG_STRING:
+        case AMF_TYPE_XML:
+            view->string.size = load_u_int32_be(p + 1);
+            view->string.bytes = (const byte *) p + 5;
+            break;
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+        case AMF_TYPE_ARRAY:
+            view->count = load_u_int32_be(p + 1);
+            break;
+        case AMF_TYPE_DATE:
+            view->date.milliseconds = load_u_int64_be(p + 1);
+            view->date.timezone = (short) load_u_int16_be(p + 9);
+            break;
+        default:
+            break;
+    }
+}
+
+
+amf_code
+amf_cursor_next(amf_cursor_t * cursor, amf_view_t * view)
+{
+    const u_byte * p = cursor->pos;
+    u_short size;
+    amf_code e;
+
+    view->key = NULL;
+    view->key_size = 0;
+
+    switch (cursor->container) {
+        case AMF_TYPE_OBJECT:
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+            if (cursor->end - p < 2) {
+                return (p == cursor->end) ? AMF_ERROR_END_TAG : AMF_ERROR_EOF;
+            }
+            size = load_u_int16_be(p);
+            if (size == 0) {
+                /* the sequence is over, the cursor stays on the empty key */
+                return AMF_ERROR_END_TAG;
+            }
+            if (cursor->end - p - 2 < size) {
+                return AMF_ERROR_EOF;
+            }
+            view->key = (const byte *) p + 2;
+            view->key_size = size;
+            p += 2 + size;
+            break;
+        case AMF_TYPE_ARRAY:
+            if (cursor->remaining == 0) {
+                return AMF_ERROR_END_TAG;
+            }
+            break;
+        default:
+            if (p >= cursor->end) {
+                return AMF_ERROR_END_TAG;
+            }
+            break;
+    }
+
+    cursor->pos = p;
+    if ((e = amf_cursor_skip_value(&cursor->pos, cursor->end, 0)) != AMF_ERROR_OK) {
+        cursor->pos = p;
+        return e;
+    }
+    if (cursor->container == AMF_TYPE_ARRAY) {
+        --(cursor->remaining);
+    }
+
+    amf_cursor_decode(view, p, cursor->pos);
+    return AMF_ERROR_OK;
+}
+
+
+amf_code
+amf_cursor_enter(amf_cursor_t * cursor, const amf_view_t * container)
+{
+    const u_byte * p = container->start;
+
+    cursor->end = p + container->size;
+    cursor->remaining = 0;
+
+    switch (container->type) {
+        case AMF_TYPE_OBJECT:
+            cursor->pos = p + 1;
+            cursor->container = AMF_TYPE_OBJECT;
+            return AMF_ERROR_OK;
+        case AMF_TYPE_CLASS:
+            /* typed object: class name, then the pairs */
+            cursor->pos = p + 3 + load_u_int16_be(p + 1);
+            cursor->container = AMF_TYPE_OBJECT;
+            return AMF_ERROR_OK;
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+            cursor->pos = p + 5;
+            cursor->container = AMF_TYPE_ASSOCIATIVE_ARRAY;
+            return AMF_ERROR_OK;
+        case AMF_TYPE_ARRAY:
+            cursor->pos = p + 5;
+            cursor->container = AMF_TYPE_ARRAY;
+            cursor->remaining = container->count;
+            return AMF_ERROR_OK;
+        default:
+            cursor->pos = cursor->end;
+            cursor->container = AMF_TYPE_END;
+            return AMF_ERROR_UNSUPPORTED_TYPE;
+    }
+}
+
+
+/* parse a strict array index, -1 if the component isn't one */
+static int64
+amf_cursor_index(const char * component, size_t size)
+{
+    int64 index = 0;
+    size_t i;
+
+    if (size == 0 || size > 10) {
+        return -1;
+    }
+    for (i = 0; i < size; ++i) {
+        if (component[i] < '0' || component[i] > '9') {
+            return -1;
+        }
+        index = index * 10 + (component[i] - '0');
+    }
+    return index;
+}
+
+
+amf_code
+amf_cursor_find(const amf_cursor_t * cursor, const char * path, amf_view_t * view)
+{
+    amf_cursor_t c = *cursor;
+    const char * component = path;
+    size_t size;
+    int64 index;
+    amf_code e;
+
+    while (1) {
+        size = strcspn(component, ".");
+
+        switch (c.container) {
+            case AMF_TYPE_OBJECT:
+            case AMF_TYPE_ASSOCIATIVE_ARRAY:
+                do {
+                    if ((e = amf_cursor_next(&c, view)) != AMF_ERROR_OK) {
+                        return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_NOT_FOUND : e;
+                    }
+                } while (view->key_size != size || memcmp(view->key, component, size) != 0);
+                break;
+            case AMF_TYPE_ARRAY:
+                if ((index = amf_cursor_index(component, size)) < 0 || index >= c.remaining) {
+                    return AMF_ERROR_NOT_FOUND;
+                }
+                do {
+                    if ((e = amf_cursor_next(&c, view)) != AMF_ERROR_OK) {
+                        return e;
+                    }
+                } while (index-- > 0);
+                break;
+            default:
+                /* top level: the value following the name */
+                do {
+                    if ((e = amf_cursor_next(&c, view)) != AMF_ERROR_OK) {
+                        return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_NOT_FOUND : e;
+                    }
+                } while (view->type != AMF_TYPE_STRING || view->string.size != size
+                     ||  memcmp(view->string.bytes, component, size) != 0);
+                if ((e = amf_cursor_next(&c, view)) != AMF_ERROR_OK) {
+                    return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_NOT_FOUND : e;
+                }
+                break;
+        }
+
+        if (component[size] == '\0') {
+            return AMF_ERROR_OK;
+        }
+        component += size + 1;
+        if ((e = amf_cursor_enter(&c, view)) != AMF_ERROR_OK) {
+            return AMF_ERROR_NOT_FOUND;
+        }
+    }
+}
+
+
+amf_code
+amf_view_find(const amf_view_t * container, const char * path, amf_view_t * view)
+{
+    amf_cursor_t cursor;
+    amf_code e;
+
+    if ((e = amf_cursor_enter(&cursor, container)) != AMF_ERROR_OK) {
+        return e;
+    }
+    return amf_cursor_find(&cursor, path, view);
+}
+
+
+u_int
+amf_view_as_doubles(const amf_view_t * array, double * out, u_int max)
+{
+    amf_cursor_t cursor;
+    amf_view_t element;
+    u_int n, run, i = 0;
+
+    if (array->type != AMF_TYPE_ARRAY || amf_cursor_enter(&cursor, array) != AMF_ERROR_OK) {
+        return 0;
+    }
+    n = (array->count < max) ? array->count : max;
+
+    while (i < n) {
+        /* runs of numbers in bulk, anything else one by one */
+        run = amf_numbers_decode(cursor.pos, (size_t) (cursor.end - cursor.pos), out + i, n - i);
+        cursor.pos += (size_t) run * 9;
+        cursor.remaining -= run;
+        if ((i += run) == n) {
+            break;
+        }
+        if (amf_cursor_next(&cursor, &element) != AMF_ERROR_OK) {
+            break;
+        }
+        out[i++] = (element.type == AMF_TYPE_NUMBER) ? element.number : NAN;
+    }
+    return i;
+}
@@ -0,0 +1,78 @@
+#ifndef __AMF_CURSOR_H__
+#define __AMF_CURSOR_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "amf.h"
+
+
+
+
+/*
+ * Lazy AMF0 decoding: a cursor walks the encoded bytes and hands out typed views of
+ * the values, skipping what is not asked for without allocating anything.
+ *
+ * A cursor iterates over a sequence of values: the top level of a buffer (the name
+ * and data of a script tag), the elements of a strict array, or the key / value pairs
+ * of an object or associative array. amf_cursor_enter() opens a container view.
+ *
+ * Paths are dot separated: object keys, or decimal indexes into strict arrays. At the
+ * top level, the first component names the value following a string equal to it, so
+ * "onMetaData.keyframes.times" works on a whole script tag body.
+ *
+ * Views point into the buffer and are valid as long as it is.
+ */
+
+#define AMF_CURSOR_MAX_DEPTH        64      // nesting accepted while skipping
+
+typedef struct amf_view_s {
+    amf_type            type;
+    const byte         *key;            // key of the value in an object, NULL otherwise
+    u_short             key_size;
+    const u_byte       *start;          // encoded value, type marker included
+    size_t              size;
+    union {
+        double          number;
+        u_byte          boolean;
+        struct {
+            const byte *bytes;          // not NUL terminated
+            u_int       size;
+        } string;
+        u_int           count;          // strict array length, associative array hint
+        amf_date_t      date;
+    };
+} amf_view_t;
+
+typedef struct amf_cursor_s {
+    const u_byte       *pos;
+    const u_byte       *end;
+    amf_type            container;      // AMF_TYPE_END at the top level
+    u_int               remaining;      // strict array elements left
+} amf_cursor_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void        amf_cursor_init(amf_cursor_t * cursor, const void * buffer, size_t size);
+/* AMF_ERROR_END_TAG once the sequence is over */
+amf_code    amf_cursor_next(amf_cursor_t * cursor, amf_view_t * view);
+/* start a cursor over the elements of an object, associative array or strict array view */
+amf_code    amf_cursor_enter(amf_cursor_t * cursor, const amf_view_t * container);
+/* find a path among the remaining values of the cursor, which is left untouched */
+amf_code    amf_cursor_find(const amf_cursor_t * cursor, const char * path, amf_view_t * view);
+/* find a path inside a container view */
+amf_code    amf_view_find(const amf_view_t * container, const char * path, amf_view_t * view);
+/* copy up to max elements of a strict array view as doubles, NaN for non numbers */
+u_int       amf_view_as_doubles(const amf_view_t * array, double * out, u_int max);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __AMF_CURSOR_H__ */
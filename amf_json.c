@@ -0,0 +1,240 @@
+#include "amf_json.h"
+
+#include <string.h>
+
+
+/* integers up to 2^53 are exact doubles */
+#define AMF_JSON_EXACT_INTEGER      9007199254740992.0
+
+/* character after the backslash, 'u' for \u00XX, 0 when copied as is */
+static const byte amf_json_escapes[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+static const char amf_json_digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+
+/* decimal digits of value at p, returns the end */
+static u_byte *
+amf_json_digits(u_byte * p, u_int64 value)
+{
+    u_byte digits[20];
+    u_int n = sizeof(digits);
+
+    while (value >= 100) {
+        n -= 2;
+        memcpy(digits + n, amf_json_digit_pairs + (value % 100) * 2, 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        n -= 2;
+        memcpy(digits + n, amf_json_digit_pairs + value * 2, 2);
+    } else {
+        digits[--n] = (u_byte) ('0' + value);
+    }
+    memcpy(p, digits + n, sizeof(digits) - n);
+    return p + (sizeof(digits) - n);
+}
+
+
+static size_t
+amf_json_raw(amf_buffer_t * buffer, const char * text, size_t size)
+{
+    u_byte * p = amf_buffer_reserve(buffer, size);
+    if (p == NULL) {
+        return 0;
+    }
+    memcpy(p, text, size);
+    buffer->size += size;
+    return size;
+}
+
+#define amf_json_literal(buffer, text)  amf_json_raw((buffer), (text), sizeof(text) - 1)
+
+
+size_t
+amf_json_integer(amf_buffer_t * buffer, u_int64 value)
+{
+    u_byte * p = amf_buffer_reserve(buffer, 20);
+    size_t size;
+
+    if (p == NULL) {
+        return 0;
+    }
+    size = (size_t) (amf_json_digits(p, value) - p);
+    buffer->size += size;
+    return size;
+}
+
+
+size_t
+amf_json_number(amf_buffer_t * buffer, double value)
+{
+    char text[AMF_JSON_NUMBER_MAX_SIZE];
+    u_byte * p, * q;
+    u_int64 bits;
+    int precision, size, i;
+
+    memcpy(&bits, &value, sizeof(double));
+    if ((bits & 0x7FF0000000000000ULL) == 0x7FF0000000000000ULL) {
+        return amf_json_literal(buffer, "null");
+    }
+    if ((p = amf_buffer_reserve(buffer, AMF_JSON_NUMBER_MAX_SIZE)) == NULL) {
+        return 0;
+    }
+
+    q = p;
+    if (value > -AMF_JSON_EXACT_INTEGER && value < AMF_JSON_EXACT_INTEGER && value == (double) (int64) value) {
+        /* timestamps, sizes, positions... -0 keeps its sign */
+        if (bits >> 63) {
+            *q++ = '-';
+            value = -value;
+        }
+        q = amf_json_digits(q, (u_int64) value);
+    } else {
+        /* the fewest significant digits reading back to the same double */
+        precision = ((bits & 0x7FF0000000000000ULL) == 0) ? 1 : 15;     // 15 always do for normal doubles
+        for (; ; ++precision) {
+            size = snprintf(text, sizeof(text), "%.*g", precision, value);
+            if (precision == 17 || strtod(text, NULL) == value) {
+                break;
+            }
+        }
+        /* the decimal point follows the locale */
+        for (i = 0; i < size; ++i) {
+            *q++ = (text[i] == ',') ? '.' : (u_byte) text[i];
+        }
+    }
+    buffer->size += (size_t) (q - p);
+    return (size_t) (q - p);
+}
+
+
+size_t
+amf_json_string(amf_buffer_t * buffer, const byte * bytes, size_t size)
+{
+    static const char hex[] = "0123456789abcdef";
+    const u_byte * in = (const u_byte*) bytes, * end = in + size, * run;
+    u_byte * p, * q;
+    byte e;
+
+    /* room for every byte escaped, runs of plain bytes are copied at once */
+    if ((p = amf_buffer_reserve(buffer, size * 6 + 2)) == NULL) {
+        return 0;
+    }
+    q = p;
+    *q++ = '"';
+    for (;;) {
+        run = in;
+        while (in < end && amf_json_escapes[*in] == 0) {
+            ++in;
+        }
+        if (in > run) {
+            memcpy(q, run, (size_t) (in - run));
+            q += in - run;
+        }
+        if (in == end) {
+            break;
+        }
+
+        e = amf_json_escapes[*in];
+        *q++ = '\\';
+        *q++ = (u_byte) e;
+        if (e == 'u') {
+            *q++ = '0';
+            *q++ = '0';
+            *q++ = (u_byte) hex[*in >> 4];
+            *q++ = (u_byte) hex[*in & 0x0F];
+        }
+        ++in;
+    }
+    *q++ = '"';
+    buffer->size += (size_t) (q - p);
+    return (size_t) (q - p);
+}
+
+
+static void
+amf_json_value(const amf_data_t * data, amf_buffer_t * buffer)
+{
+    amf_node_t * node, * first;
+    amf_data_t * name;
+    u_int64 bits;
+    double number;
+
+    if (data == NULL) {
+        amf_json_literal(buffer, "null");
+        return;
+    }
+
+    switch (data->type) {
+        case AMF_TYPE_NUMBER:
+            bits = amf_number_get_value(data);
+            memcpy(&number, &bits, sizeof(double));
+            amf_json_number(buffer, number);
+            break;
+        case AMF_TYPE_BOOLEAN:
+            if (amf_boolean_get_value(data)) {
+                amf_json_literal(buffer, "true");
+            } else {
+                amf_json_literal(buffer, "false");
+            }
+            break;
+        case AMF_TYPE_STRING:
+            amf_json_string(buffer, amf_string_get_bytes(data), amf_string_get_size(data));
+            break;
+        case AMF_TYPE_XML:
+            amf_json_string(buffer, data->xmlstring_data.mbstr, data->xmlstring_data.size);
+            break;
+        case AMF_TYPE_OBJECT:
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+            amf_json_literal(buffer, "{");
+            for (node = first = amf_object_first(data); node != NULL && !buffer->error; node = amf_object_next(node)) {
+                if (node != first) {
+                    amf_json_literal(buffer, ",");
+                }
+                name = amf_object_get_name(node);
+                amf_json_string(buffer, amf_string_get_bytes(name), amf_string_get_size(name));
+                amf_json_literal(buffer, ":");
+                amf_json_value(amf_object_get_data(node), buffer);
+            }
+            amf_json_literal(buffer, "}");
+            break;
+        case AMF_TYPE_ARRAY:
+            amf_json_literal(buffer, "[");
+            for (node = first = amf_array_first(data); node != NULL && !buffer->error; node = amf_array_next(node)) {
+                if (node != first) {
+                    amf_json_literal(buffer, ",");
+                }
+                amf_json_value(amf_array_get(node), buffer);
+            }
+            amf_json_literal(buffer, "]");
+            break;
+        case AMF_TYPE_DATE:
+            bits = amf_date_get_milliseconds(data);
+            memcpy(&number, &bits, sizeof(double));
+            amf_json_number(buffer, number);
+            break;
+        default:
+            amf_json_literal(buffer, "null");
+            break;
+    }
+}
+
+
+size_t
+amf_data_json(const amf_data_t * data, amf_buffer_t * buffer)
+{
+    size_t start = buffer->size;
+
+    amf_json_value(data, buffer);
+    return buffer->error ? 0 : buffer->size - start;
+}
@@ -0,0 +1,47 @@
+#ifndef __AMF_JSON_H__
+#define __AMF_JSON_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "amf.h"
+
+
+
+
+/*
+ * JSON output of AMF data, appended to a growable buffer: nothing goes through stdio,
+ * the caller writes the buffer out when it suits it.
+ *
+ * Numbers take the fewest significant digits reading back to the same double (15 to
+ * 17 for normal ones, from 1 for subnormals), integers below 2^53 are written without
+ * going through printf. NaN and
+ * infinities have no JSON form and become null, as do undefined and class values.
+ * Objects and associative arrays become objects, strict arrays arrays, dates their
+ * milliseconds and XML documents strings. String bytes are copied as they are apart
+ * from the escapes JSON requires, AMF strings being UTF-8.
+ */
+
+#define AMF_JSON_NUMBER_MAX_SIZE    32      // longest number written, sign and exponent included
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* append AMF data as JSON, returns the bytes appended, 0 when out of memory */
+size_t      amf_data_json(const amf_data_t * data, amf_buffer_t * buffer);
+
+/* JSON values, 0 when out of memory */
+size_t      amf_json_number(amf_buffer_t * buffer, double value);
+size_t      amf_json_integer(amf_buffer_t * buffer, u_int64 value);
+size_t      amf_json_string(amf_buffer_t * buffer, const byte * bytes, size_t size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __AMF_JSON_H__ */
@@ -0,0 +1,380 @@
+#include "amf_sax.h"
+
+
+/* reader states */
+#define AMF_SAX_VALUE           0   // type marker
+#define AMF_SAX_SCALAR          1   // number, boolean or date payload
+#define AMF_SAX_TEXT_SIZE       2   // string length
+#define AMF_SAX_TEXT            3   // string bytes, reported whole
+#define AMF_SAX_LONG_TEXT       4   // long string bytes, reported in parts
+#define AMF_SAX_COUNT           5   // associative or strict array count
+#define AMF_SAX_KEY_SIZE        6
+#define AMF_SAX_KEY             7
+#define AMF_SAX_OBJECT_END      8   // after the empty key, optional end marker
+
+
+#define amf_sax_call(sax, cb, ...) \
+    ((sax)->handler->cb == NULL || (sax)->handler->cb(__VA_ARGS__, (sax)->user_data) == 0)
+
+#define amf_sax_call0(sax, cb) \
+    ((sax)->handler->cb == NULL || (sax)->handler->cb((sax)->user_data) == 0)
+
+
+void
+amf_sax_init(amf_sax_t * sax, const amf_sax_handler_t * handler, void * user_data)
+{
+    memset(sax, 0, sizeof(amf_sax_t));
+    sax->handler = handler;
+    sax->user_data = user_data;
+    sax->state = AMF_SAX_VALUE;
+}
+
+
+void
+amf_sax_free(amf_sax_t * sax)
+{
+    if (sax != NULL) {
+        free(sax->text);
+        sax->text = NULL;
+        sax->text_capacity = 0;
+    }
+}
+
+
+static amf_code
+amf_sax_fail(amf_sax_t * sax, amf_code error)
+{
+    sax->error = error;
+    return error;
+}
+
+
+/* expect `need` bytes for the next fixed size field */
+#define amf_sax_expect(sax, s, n) \
+    do { (sax)->state = (s); (sax)->need = (n); (sax)->have = 0; } while (0)
+
+
+/* a value is complete: close the strict arrays it ends and pick the next state */
+static amf_code
+amf_sax_value_done(amf_sax_t * sax)
+{
+    amf_sax_frame_t * frame;
+
+    while (sax->depth > 0) {
+        frame = &sax->stack[sax->depth - 1];
+        if (frame->type != AMF_TYPE_ARRAY) {
+            amf_sax_expect(sax, AMF_SAX_KEY_SIZE, 2);
+            return AMF_ERROR_OK;
+        }
+        if (--(frame->remaining) > 0) {
+            break;
+        }
+        --(sax->depth);
+        if (!amf_sax_call0(sax, end_array)) {
+            return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+        }
+    }
+    sax->state = AMF_SAX_VALUE;
+    return AMF_ERROR_OK;
+}
+
+
+static amf_code
+amf_sax_push(amf_sax_t * sax, amf_type type, u_int remaining)
+{
+    if (sax->depth == AMF_SAX_MAX_DEPTH) {
+        return amf_sax_fail(sax, AMF_ERROR_UNSUPPORTED_TYPE);
+    }
+    sax->stack[sax->depth].type = type;
+    sax->stack[sax->depth].remaining = remaining;
+    ++(sax->depth);
+    return AMF_ERROR_OK;
+}
+
+
+static amf_code
+amf_sax_end_object(amf_sax_t * sax)
+{
+    --(sax->depth);
+    if (!amf_sax_call0(sax, end_object)) {
+        return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+    }
+    return amf_sax_value_done(sax);
+}
+
+
+#define amf_sax_in_object(sax) \
+    ((sax)->depth > 0 && (sax)->stack[(sax)->depth - 1].type != AMF_TYPE_ARRAY)
+
+
+static amf_code
+amf_sax_on_type(amf_sax_t * sax, amf_type type)
+{
+    sax->type = type;
+
+    switch (type) {
+        case AMF_TYPE_NUMBER:
+            amf_sax_expect(sax, AMF_SAX_SCALAR, 8);
+            return AMF_ERROR_OK;
+        case AMF_TYPE_BOOLEAN:
+            amf_sax_expect(sax, AMF_SAX_SCALAR, 1);
+            return AMF_ERROR_OK;
+        case AMF_TYPE_DATE:
+            amf_sax_expect(sax, AMF_SAX_SCALAR, 10);
+            return AMF_ERROR_OK;
+        case AMF_TYPE_STRING:
+            amf_sax_expect(sax, AMF_SAX_TEXT_SIZE, 2);
+            return AMF_ERROR_OK;
+        case AMF_TYPE_LONG_STRING:
+        case AMF_TYPE_XML:
+            amf_sax_expect(sax, AMF_SAX_TEXT_SIZE, 4);
+            return AMF_ERROR_OK;
+        case AMF_TYPE_ASSOCIATIVE_ARRAY:
+        case AMF_TYPE_ARRAY:
+            amf_sax_expect(sax, AMF_SAX_COUNT, 4);
+            return AMF_ERROR_OK;
+        case AMF_TYPE_OBJECT:
+            if (amf_sax_push(sax, AMF_TYPE_OBJECT, 0) != AMF_ERROR_OK) {
+                return sax->error;
+            }
+            if (!amf_sax_call(sax, begin_object, AMF_TYPE_OBJECT, 0)) {
+                return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+            }
+            amf_sax_expect(sax, AMF_SAX_KEY_SIZE, 2);
+            return AMF_ERROR_OK;
+        case AMF_TYPE_NULL:
+        case AMF_TYPE_UNDEFINED:
+            if (!amf_sax_call(sax, null, type)) {
+                return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+            }
+            return amf_sax_value_done(sax);
+        case AMF_TYPE_END:
+            /* unnamed terminator, as amf_data_read() accepts */
+            if (amf_sax_in_object(sax)) {
+                return amf_sax_end_object(sax);
+            }
+            return amf_sax_fail(sax, AMF_ERROR_END_TAG);
+        case AMF_TYPE_CLASS:
+            return amf_sax_fail(sax, AMF_ERROR_UNSUPPORTED_TYPE);
+        default:
+            return amf_sax_fail(sax, AMF_ERROR_UNKNOWN_TYPE);
+    }
+}
+
+
+/* a fixed size field is complete in scratch */
+static amf_code
+amf_sax_on_field(amf_sax_t * sax)
+{
+    const u_byte * p = sax->scratch;
+    u_int64 bits;
+    double value;
+    u_int n;
+
+    switch (sax->state) {
+        case AMF_SAX_SCALAR:
+            if (sax->type == AMF_TYPE_BOOLEAN) {
+                if (!amf_sax_call(sax, boolean, p[0])) {
+                    return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+                }
+                return amf_sax_value_done(sax);
+            }
+            bits = load_u_int64_be(p);
+            memcpy(&value, &bits, sizeof(double));
+            if (sax->type == AMF_TYPE_NUMBER) {
+                if (!amf_sax_call(sax, number, value)) {
+                    return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+                }
+            } else if (!amf_sax_call(sax, date, value, (short) load_u_int16_be(p + 8))) {
+                return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+            }
+            return amf_sax_value_done(sax);
+
+        case AMF_SAX_TEXT_SIZE:
+            n = (sax->need == 2) ? load_u_int16_be(p) : load_u_int32_be(p);
+            if (n == 0) {
+                if (!amf_sax_call(sax, string, "", 0, 0)) {
+                    return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+                }
+                return amf_sax_value_done(sax);
+            }
+            if (sax->type == AMF_TYPE_STRING) {
+                amf_sax_expect(sax, AMF_SAX_TEXT, n);
+            } else {
+                sax->state = AMF_SAX_LONG_TEXT;
+                sax->text_left = n;
+            }
+            return AMF_ERROR_OK;
+
+        case AMF_SAX_COUNT:
+            n = load_u_int32_be(p);
+            if (sax->type == AMF_TYPE_ASSOCIATIVE_ARRAY) {
+                if (amf_sax_push(sax, AMF_TYPE_ASSOCIATIVE_ARRAY, 0) != AMF_ERROR_OK) {
+                    return sax->error;
+                }
+                if (!amf_sax_call(sax, begin_object, AMF_TYPE_ASSOCIATIVE_ARRAY, n)) {
+                    return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+                }
+                amf_sax_expect(sax, AMF_SAX_KEY_SIZE, 2);
+                return AMF_ERROR_OK;
+            }
+            if (!amf_sax_call(sax, begin_array, n)) {
+                return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+            }
+            if (n == 0) {
+                if (!amf_sax_call0(sax, end_array)) {
+                    return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+                }
+                return amf_sax_value_done(sax);
+            }
+            if (amf_sax_push(sax, AMF_TYPE_ARRAY, n) != AMF_ERROR_OK) {
+                return sax->error;
+            }
+            sax->state = AMF_SAX_VALUE;
+            return AMF_ERROR_OK;
+
+        case AMF_SAX_KEY_SIZE:
+            n = load_u_int16_be(p);
+            if (n == 0) {
+                sax->state = AMF_SAX_OBJECT_END;
+            } else {
+                amf_sax_expect(sax, AMF_SAX_KEY, n);
+            }
+            return AMF_ERROR_OK;
+
+        default:
+            return amf_sax_fail(sax, AMF_ERROR_UNKNOWN_TYPE);
+    }
+}
+
+
+/* a key or a string is complete */
+static amf_code
+amf_sax_on_text(amf_sax_t * sax, const byte * text, size_t size)
+{
+    if (sax->state == AMF_SAX_KEY) {
+        if (!amf_sax_call(sax, key, text, size)) {
+            return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+        }
+        sax->state = AMF_SAX_VALUE;
+        return AMF_ERROR_OK;
+    }
+    if (!amf_sax_call(sax, string, text, size, 0)) {
+        return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+    }
+    return amf_sax_value_done(sax);
+}
+
+
+amf_code
+amf_sax_feed(amf_sax_t * sax, const void * data, size_t size)
+{
+    const u_byte * p = (const u_byte *) data;
+    const u_byte * end = p + size;
+    size_t n;
+    byte * text;
+
+    while (p < end && sax->error == AMF_ERROR_OK) {
+        switch (sax->state) {
+            case AMF_SAX_VALUE:
+                ++(sax->offset);
+                amf_sax_on_type(sax, (amf_type) *p++);
+                break;
+
+            case AMF_SAX_SCALAR:
+            case AMF_SAX_TEXT_SIZE:
+            case AMF_SAX_COUNT:
+            case AMF_SAX_KEY_SIZE:
+                n = sax->need - sax->have;
+                if (n > (size_t) (end - p)) {
+                    n = (size_t) (end - p);
+                }
+                memcpy(sax->scratch + sax->have, p, n);
+                sax->have += (u_int) n;
+                sax->offset += n;
+                p += n;
+                if (sax->have == sax->need) {
+                    amf_sax_on_field(sax);
+                }
+                break;
+
+            case AMF_SAX_TEXT:
+            case AMF_SAX_KEY:
+                /* whole in the input: no copy */
+                if (sax->have == 0 && (size_t) (end - p) >= sax->need) {
+                    p += sax->need;
+                    sax->offset += sax->need;
+                    amf_sax_on_text(sax, (const byte *) p - sax->need, sax->need);
+                    break;
+                }
+                if (sax->text_capacity < sax->need) {
+                    text = (byte *) realloc(sax->text, sax->need);
+                    if (text == NULL) {
+                        return amf_sax_fail(sax, AMF_ERROR_MEMORY);
+                    }
+                    sax->text = text;
+                    sax->text_capacity = sax->need;
+                }
+                n = sax->need - sax->have;
+                if (n > (size_t) (end - p)) {
+                    n = (size_t) (end - p);
+                }
+                memcpy(sax->text + sax->have, p, n);
+                sax->have += (u_int) n;
+                sax->offset += n;
+                p += n;
+                if (sax->have == sax->need) {
+                    amf_sax_on_text(sax, sax->text, sax->need);
+                }
+                break;
+
+            case AMF_SAX_LONG_TEXT:
+                n = (size_t) (end - p);
+                if (n > sax->text_left) {
+                    n = (size_t) sax->text_left;
+                }
+                sax->text_left -= n;
+                sax->offset += n;
+                p += n;
+                if (!amf_sax_call(sax, string, (const byte *) p - n, n, sax->text_left > 0)) {
+                    return amf_sax_fail(sax, AMF_ERROR_STOPPED);
+                }
+                if (sax->text_left == 0) {
+                    amf_sax_value_done(sax);
+                }
+                break;
+
+            case AMF_SAX_OBJECT_END:
+                if (*p == AMF_TYPE_END) {
+                    ++(sax->offset);
+                    ++p;
+                }
+                amf_sax_end_object(sax);
+                break;
+
+            default:
+                return amf_sax_fail(sax, AMF_ERROR_UNKNOWN_TYPE);
+        }
+    }
+    return sax->error;
+}
+
+
+amf_code
+amf_sax_finish(amf_sax_t * sax)
+{
+    if (sax->error != AMF_ERROR_OK) {
+        return sax->error;
+    }
+    /* an object may end on its empty key, at the end of the input */
+    if (sax->state == AMF_SAX_OBJECT_END) {
+        amf_sax_end_object(sax);
+        if (sax->error != AMF_ERROR_OK) {
+            return sax->error;
+        }
+    }
+    if (sax->state != AMF_SAX_VALUE || sax->depth > 0) {
+        return amf_sax_fail(sax, AMF_ERROR_EOF);
+    }
+    return AMF_ERROR_OK;
+}
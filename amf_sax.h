@@ -0,0 +1,84 @@
+#ifndef __AMF_SAX_H__
+#define __AMF_SAX_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "amf.h"
+
+
+
+
+/*
+ * Event driven AMF0 reader.
+ *
+ * The bytes are pushed with amf_sax_feed() in chunks of any size and the handler is
+ * called as values complete, nothing is kept once reported. Nesting is tracked on an
+ * explicit stack of AMF_SAX_MAX_DEPTH frames and strings are gathered in a buffer of
+ * at most 64 KiB, so the memory used doesn't depend on the input. Long strings and
+ * XML are reported in parts, `partial` being set on all but the last one.
+ *
+ * Pointers given to the handler are only valid during the call. A handler returning
+ * non-zero stops the reader with AMF_ERROR_STOPPED. NULL handlers are skipped.
+ */
+
+#define AMF_SAX_MAX_DEPTH           64
+
+typedef struct amf_sax_handler_s {
+    int (*begin_object)(amf_type type, u_int count_hint, void * user_data);    /* object or associative array */
+    int (*end_object)(void * user_data);
+    int (*begin_array)(u_int count, void * user_data);
+    int (*end_array)(void * user_data);
+    int (*key)(const byte * key, size_t size, void * user_data);
+    int (*number)(double value, void * user_data);
+    int (*boolean)(u_byte value, void * user_data);
+    int (*string)(const byte * bytes, size_t size, u_byte partial, void * user_data);
+    int (*date)(double milliseconds, short timezone, void * user_data);
+    int (*null)(amf_type type, void * user_data);                              /* null or undefined */
+} amf_sax_handler_t;
+
+typedef struct amf_sax_frame_s {
+    amf_type            type;
+    u_int               remaining;      // strict array elements left
+} amf_sax_frame_t;
+
+typedef struct amf_sax_s {
+    const amf_sax_handler_t    *handler;
+    void                       *user_data;
+
+    u_byte                      state;
+    amf_type                    type;           // value being read
+    u_byte                      scratch[10];    // fixed size fields
+    u_int                       have;
+    u_int                       need;
+    u_int64                     text_left;      // long string bytes still to report
+
+    byte                       *text;           // keys and strings split across feeds
+    u_int                       text_capacity;
+
+    amf_sax_frame_t             stack[AMF_SAX_MAX_DEPTH];
+    u_int                       depth;
+
+    u_int64                     offset;         // bytes consumed
+    amf_code                    error;
+} amf_sax_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void        amf_sax_init(amf_sax_t * sax, const amf_sax_handler_t * handler, void * user_data);
+amf_code    amf_sax_feed(amf_sax_t * sax, const void * data, size_t size);
+/* AMF_ERROR_EOF if the input stopped inside a value */
+amf_code    amf_sax_finish(amf_sax_t * sax);
+void        amf_sax_free(amf_sax_t * sax);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __AMF_SAX_H__ */
@@ -0,0 +1,140 @@
+#include "amf_template.h"
+
+#include <string.h>
+
+
+amf_code
+amf_template_init(amf_template_t * tpl, amf_data_t * const * values, u_int count)
+{
+    amf_buffer_t buffer;
+    u_int i;
+
+    memset(tpl, 0, sizeof(amf_template_t));
+    amf_buffer_init(&buffer, NULL);
+    for (i = 0; i < count; ++i) {
+        if (values[i] == NULL) {
+            amf_buffer_free(&buffer);
+            return AMF_ERROR_NULL_POINTER;
+        }
+        amf_data_encode(values[i], &buffer);
+        if (buffer.error) {
+            amf_buffer_free(&buffer);
+            return AMF_ERROR_MEMORY;
+        }
+    }
+
+    /* the template keeps the encoded bytes */
+    tpl->data = buffer.data;
+    tpl->size = buffer.size;
+    tpl->capacity = buffer.capacity;
+    return AMF_ERROR_OK;
+}
+
+
+void
+amf_template_free(amf_template_t * tpl)
+{
+    free(tpl->data);
+    memset(tpl, 0, sizeof(amf_template_t));
+}
+
+
+amf_code
+amf_template_bind(amf_template_t * tpl, u_int index, const char * path, u_short max_size, u_int * slot)
+{
+    amf_template_slot_t * s;
+    amf_cursor_t cursor;
+    amf_view_t view;
+    u_byte * data;
+    size_t room;
+    amf_code e;
+
+    if (tpl->slot_count == AMF_TEMPLATE_MAX_SLOTS) {
+        return AMF_ERROR_LIMIT;
+    }
+
+    /* the top level value, then the path inside it */
+    amf_cursor_init(&cursor, tpl->data, tpl->size);
+    do {
+        if ((e = amf_cursor_next(&cursor, &view)) != AMF_ERROR_OK) {
+            return (e == AMF_ERROR_END_TAG) ? AMF_ERROR_NOT_FOUND : e;
+        }
+    } while (index-- > 0);
+    if (path != NULL && path[0] != '\0' && (e = amf_view_find(&view, path, &view)) != AMF_ERROR_OK) {
+        return e;
+    }
+
+    s = &tpl->slots[tpl->slot_count];
+    s->offset = (size_t) (view.start - tpl->data);
+    s->type = view.type;
+    s->size = 0;
+    s->max_size = 0;
+
+    if (view.type == AMF_TYPE_STRING) {
+        s->size = (u_short) view.string.size;
+        s->max_size = (max_size > s->size) ? max_size : s->size;
+
+        /* room for the longest string right away, patches never allocate */
+        room = tpl->capacity + (s->max_size - s->size);
+        if ((data = (u_byte*) realloc(tpl->data, room)) == NULL) {
+            return AMF_ERROR_MEMORY;
+        }
+        tpl->data = data;
+        tpl->capacity = room;
+    } else if (view.type != AMF_TYPE_NUMBER) {
+        return AMF_ERROR_UNSUPPORTED_TYPE;
+    }
+
+    *slot = tpl->slot_count++;
+    return AMF_ERROR_OK;
+}
+
+
+void
+amf_template_set_number(amf_template_t * tpl, u_int slot, double value)
+{
+    u_int64 bits;
+    u_byte * p;
+
+    if (slot < tpl->slot_count && tpl->slots[slot].type == AMF_TYPE_NUMBER) {
+        memcpy(&bits, &value, sizeof(double));
+        p = tpl->data + tpl->slots[slot].offset + 1;
+        store_u_int32_be(p, (u_int) (bits >> 32));
+        store_u_int32_be(p + 4, (u_int) bits);
+    }
+}
+
+
+amf_code
+amf_template_set_string(amf_template_t * tpl, u_int slot, const char * bytes, u_short size)
+{
+    amf_template_slot_t * s;
+    size_t tail;
+    u_byte * p;
+    u_int i;
+
+    if (slot >= tpl->slot_count || tpl->slots[slot].type != AMF_TYPE_STRING) {
+        return AMF_ERROR_NOT_FOUND;
+    }
+    s = &tpl->slots[slot];
+    if (size > s->max_size) {
+        return AMF_ERROR_LIMIT;
+    }
+
+    /* move what follows, then the slots after this one */
+    p = tpl->data + s->offset + 3;
+    if (size != s->size) {
+        tail = tpl->size - (s->offset + 3 + s->size);
+        memmove(p + size, p + s->size, tail);
+        tpl->size = tpl->size - s->size + size;
+        for (i = 0; i < tpl->slot_count; ++i) {
+            if (tpl->slots[i].offset > s->offset) {
+                tpl->slots[i].offset = tpl->slots[i].offset - s->size + size;
+            }
+        }
+        s->size = size;
+    }
+    store_u_int16_be(p - 2, size);
+    memcpy(p, bytes, size);
+    return AMF_ERROR_OK;
+}
@@ -0,0 +1,63 @@
+#ifndef __AMF_TEMPLATE_H__
+#define __AMF_TEMPLATE_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "amf.h"
+#include "amf_cursor.h"
+
+
+
+
+/*
+ * Precompiled AMF0 messages: a constant sequence of values (onMetaData, an RTMP
+ * _result or onStatus...) is encoded once, then the numbers and strings bound as slots
+ * are overwritten in place before each use; data / size are the message, ready to send.
+ *
+ * A slot is the value at a path (see amf_cursor.h) inside the top level value of the
+ * given index, or that value itself for an empty path. Number slots are patched in
+ * place; string slots take up to the max_size given when bound, the bytes after them
+ * move when their size changes. AMF0 containers don't encode their byte size, nothing
+ * else needs to be fixed up.
+ */
+
+#define AMF_TEMPLATE_MAX_SLOTS      16
+
+typedef struct amf_template_slot_s {
+    size_t          offset;         // value, type marker included
+    amf_type        type;           // AMF_TYPE_NUMBER or AMF_TYPE_STRING
+    u_short         size;           // string bytes
+    u_short         max_size;
+} amf_template_slot_t;
+
+typedef struct amf_template_s {
+    u_byte             *data;
+    size_t              size;
+    size_t              capacity;       // room for every string slot at its max size
+    u_int               slot_count;
+    amf_template_slot_t slots[AMF_TEMPLATE_MAX_SLOTS];
+} amf_template_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* encode count values one after the other */
+amf_code    amf_template_init(amf_template_t * tpl, amf_data_t * const * values, u_int count);
+void        amf_template_free(amf_template_t * tpl);
+/* bind the number or string at path in the top level value index, max_size bounds strings */
+amf_code    amf_template_bind(amf_template_t * tpl, u_int index, const char * path, u_short max_size, u_int * slot);
+void        amf_template_set_number(amf_template_t * tpl, u_int slot, double value);
+/* AMF_ERROR_LIMIT past the max size of the slot */
+amf_code    amf_template_set_string(amf_template_t * tpl, u_int slot, const char * bytes, u_short size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __AMF_TEMPLATE_H__ */
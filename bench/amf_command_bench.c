@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "amf.h"
+#include "amf_command.h"
+
+
+/*
+ * Typed RTMP command codec against the generic AMF tree, on the messages of a
+ * publishing session:
+ *
+ *   decode  an FMLE connect, amf_command_decode() vs amf_data_buffer_read() of each value
+ *   encode  the connect _result, amf_command_encode() vs building and encoding the tree
+ *
+ * Build from the repository root:
+ *
+ *   cc -O2 -I. bench/amf_command_bench.c amf.c amf_cursor.c amf_command.c util.c -o amf_command_bench
+ *   ./amf_command_bench [iterations]
+ */
+
+#define BENCH_DEFAULT_ITERATIONS    200000
+
+
+/* monotonic clock, in microseconds */
+static double
+bench_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec * 1e6 + (double) t.tv_nsec / 1e3;
+}
+
+
+/* the values one after another, as in a command message body */
+static size_t
+bench_encode_values(amf_data_t ** values, int count, amf_buffer_t * buffer)
+{
+    int i;
+
+    buffer->size = 0;
+    for (i = 0; i < count; ++i) {
+        amf_data_encode(values[i], buffer);
+    }
+    return buffer->size;
+}
+
+
+static void
+bench_free_values(amf_data_t ** values, int count)
+{
+    int i;
+    for (i = 0; i < count; ++i) {
+        amf_data_free(values[i]);
+    }
+}
+
+
+/* connect as sent by Flash Media Live Encoder */
+static size_t
+bench_connect_message(amf_buffer_t * buffer)
+{
+    amf_data_t * values[3];
+    amf_data_t * object;
+    size_t size;
+
+    object = amf_object_new();
+    amf_object_add(object, "app", amf_str("live"));
+    amf_object_add(object, "flashVer", amf_str("FMLE/3.0 (compatible; FMSc/1.0)"));
+    amf_object_add(object, "type", amf_str("nonprivate"));
+    amf_object_add(object, "tcUrl", amf_str("rtmp://edge.example.com/live"));
+    amf_object_add(object, "fpad", amf_boolean_new(0));
+    amf_object_add(object, "capabilities", amf_number_new_double(239));
+    amf_object_add(object, "audioCodecs", amf_number_new_double(3575));
+    amf_object_add(object, "videoCodecs", amf_number_new_double(252));
+    amf_object_add(object, "videoFunction", amf_number_new_double(1));
+    amf_object_add(object, "objectEncoding", amf_number_new_double(0));
+
+    values[0] = amf_str("connect");
+    values[1] = amf_number_new_double(1);
+    values[2] = object;
+    size = bench_encode_values(values, 3, buffer);
+    bench_free_values(values, 3);
+    return size;
+}
+
+
+static void
+bench_decode(const byte * message, size_t size, int iterations)
+{
+    amf_command_t command;
+    amf_data_t * data;
+    size_t offset;
+    double start;
+    int i, k;
+
+    if (amf_command_decode(&command, message, size) != AMF_ERROR_OK || command.type != AMF_COMMAND_CONNECT) {
+        fprintf(stderr, "connect not decoded\n");
+        exit(EXIT_FAILURE);
+    }
+
+    start = bench_now();
+    for (i = 0; i < iterations; ++i) {
+        amf_command_decode(&command, message, size);
+    }
+    printf("decode, %zu bytes connect:\ttyped %.3fus", size, (bench_now() - start) / iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; ++i) {
+        for (k = 0, offset = 0; k < 3; ++k) {
+            data = amf_data_buffer_read((byte*) message + offset, size - offset);
+            offset += amf_data_size(data);
+            amf_data_free(data);
+        }
+    }
+    printf("\ttree %.3fus\n", (bench_now() - start) / iterations);
+}
+
+
+static void
+bench_encode(amf_buffer_t * buffer, int iterations)
+{
+    amf_data_t * values[4];
+    amf_data_t * properties, * information;
+    amf_command_t command;
+    double start;
+    int i;
+
+    amf_command_init(&command, AMF_COMMAND_RESULT, 1);
+    command.fields = AMF_STATUS_FMS_VER | AMF_STATUS_CAPABILITIES | AMF_STATUS_MODE
+                   | AMF_STATUS_LEVEL | AMF_STATUS_CODE | AMF_STATUS_DESCRIPTION | AMF_STATUS_OBJECT_ENCODING;
+    command.status.fms_ver.bytes = "FMS/3,0,1,123";
+    command.status.fms_ver.size = 13;
+    command.status.capabilities = 31;
+    command.status.mode = 1;
+    command.status.level.bytes = "status";
+    command.status.level.size = 6;
+    command.status.code.bytes = "NetConnection.Connect.Success";
+    command.status.code.size = 29;
+    command.status.description.bytes = "Connection succeeded.";
+    command.status.description.size = 21;
+
+    start = bench_now();
+    for (i = 0; i < iterations; ++i) {
+        buffer->size = 0;
+        amf_command_encode(&command, buffer);
+    }
+    printf("encode, connect _result:\ttyped %.3fus", (bench_now() - start) / iterations);
+
+    start = bench_now();
+    for (i = 0; i < iterations; ++i) {
+        properties = amf_object_new();
+        amf_object_add(properties, "fmsVer", amf_str("FMS/3,0,1,123"));
+        amf_object_add(properties, "capabilities", amf_number_new_double(31));
+        amf_object_add(properties, "mode", amf_number_new_double(1));
+
+        information = amf_object_new();
+        amf_object_add(information, "level", amf_str("status"));
+        amf_object_add(information, "code", amf_str("NetConnection.Connect.Success"));
+        amf_object_add(information, "description", amf_str("Connection succeeded."));
+        amf_object_add(information, "objectEncoding", amf_number_new_double(0));
+
+        values[0] = amf_str("_result");
+        values[1] = amf_number_new_double(1);
+        values[2] = properties;
+        values[3] = information;
+        bench_encode_values(values, 4, buffer);
+        bench_free_values(values, 4);
+    }
+    printf("\ttree %.3fus\n", (bench_now() - start) / iterations);
+}
+
+
+int
+main(int argc, char ** argv)
+{
+    amf_buffer_t buffer;
+    byte * message;
+    size_t size;
+    int iterations = (argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+
+    if (iterations <= 0) {
+        iterations = BENCH_DEFAULT_ITERATIONS;
+    }
+    amf_buffer_init(&buffer, NULL);
+
+    /* the message outlives the buffer reused below */
+    size = bench_connect_message(&buffer);
+    message = (byte*) malloc(size);
+    if (buffer.error || message == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    memcpy(message, buffer.data, size);
+
+    bench_decode(message, size, iterations);
+    bench_encode(&buffer, iterations);
+
+    free(message);
+    amf_buffer_free(&buffer);
+    return EXIT_SUCCESS;
+}
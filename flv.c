@@ -69,6 +69,7 @@ flv_read_header(flv_stream_t * stream, flv_header_t * header)
         std_log_error("read stream header failed");
         return FLV_ERROR_EOF;
     }
+    header->offset = load_u_int32_be(&header->offset);
 
     stream->state = FLV_STREAM_STATE_PREV_TAG_SIZE;
     return FLV_OK;
@@ -98,7 +99,7 @@ flv_read_prev_tag_size(flv_stream_t * stream, u_int * prev_tag_size)
     u_int val;
     if (fread(&val, sizeof(u_int), 1, stream->flvin) != 0) {
         stream->state = FLV_STREAM_STATE_TAG;
-        *prev_tag_size = val;
+        *prev_tag_size = load_u_int32_be(&val);
         return FLV_OK;
     }
 
@@ -136,23 +137,23 @@ flv_read_tag(flv_stream_t * stream, flv_tag_header_t * tag)
     }
 
     if (stream->state == FLV_STREAM_STATE_TAG) {
-        u_int blen;
+        u_byte buffer[FLV_TAG_SIZE];
         stream->current_tag_offset = ftell(stream->flvin);
 
-        if (fread(&tag->tag_type,       sizeof(tag->tag_type),      1, stream->flvin) == 0
-        ||  fread(&blen,                FLV_TAG_SIZE_BODY_LENGTH,   1, stream->flvin) == 0
-        ||  fread(&tag->timestamp,      FLV_TAG_SIZE_TIMESTAMP,     1, stream->flvin) == 0
-        ||  fread(&tag->timestamp_ex,   sizeof(tag->timestamp_ex),  1, stream->flvin) == 0
-        ||  fread(&tag->stream_ID,      FLV_TAG_SIZE_STREAM_ID,     1, stream->flvin) == 0)
-        {
+        if (fread(buffer, FLV_TAG_SIZE, 1, stream->flvin) == 0) {
             std_log_error("read tag header failed");
             return FLV_ERROR_EOF;
         }
-        blen = swap32_be(blen);
-        tag->body_length = blen;
+
+        /* 24 bits fields are big-endian, timestamp_ex is the high byte of the timestamp */
+        tag->tag_type       = buffer[0];
+        tag->body_length    = load_u_int24_be(buffer + 1);
+        tag->timestamp      = load_u_int24_be(buffer + 4);
+        tag->timestamp_ex   = buffer[7];
+        tag->stream_ID      = load_u_int24_be(buffer + 8);
 
         memcpy(&stream->current_tag, tag, sizeof(flv_tag_header_t));
-        stream->current_tag_body_length = blen;
+        stream->current_tag_body_length = tag->body_length;
         stream->current_tag_body_overflow = 0;
         stream->state = FLV_STREAM_STATE_TAG_BODY;
         return FLV_OK;
@@ -247,6 +248,7 @@ flv_read_video_tag(flv_stream_t * stream, flv_video_tag * tag)
 flv_code 
 flv_read_metadata(flv_stream_t * stream, amf_data_t ** name, amf_data_t ** data)
 {
+    amf_limits_t limits;
     amf_data_t * d;
     amf_code e;
     size_t data_size;
@@ -265,8 +267,13 @@ flv_read_metadata(flv_stream_t * stream, amf_data_t ** name, amf_data_t ** data)
         return FLV_ERROR_EMPTY_TAG;
     }
 
+    /* untrusted input: the decoder stops early rather than allocate without bound */
+    limits.max_depth = FLV_METADATA_MAX_DEPTH;
+    limits.max_elements = stream->current_tag_body_length;
+    limits.max_bytes = FLV_METADATA_MAX_BYTES;
+
     /* read metadata tag name */
-    d = amf_data_file_read(stream->flvin);
+    d = amf_data_file_read_limited(stream->flvin, &limits);
     *name = d;
     e = amf_data_get_error_code(d);
     if (e == AMF_ERROR_EOF) {
@@ -292,7 +299,8 @@ flv_read_metadata(flv_stream_t * stream, amf_data_t ** name, amf_data_t ** data)
     }
 
     /* read metadata contents */
-    d = amf_data_file_read(stream->flvin);
+    limits.max_elements = stream->current_tag_body_length;
+    d = amf_data_file_read_limited(stream->flvin, &limits);
     *data = d;
     e = amf_data_get_error_code(d);
     if (e == AMF_ERROR_EOF) {
@@ -350,6 +358,30 @@ flv_read_tag_body(flv_stream_t * stream, void * buffer, size_t buffer_size)
 }
 
 
+/* read the current tag body without consuming it, the stream state is left untouched */
+size_t
+flv_peek_tag_body(flv_stream_t * stream, void * buffer, size_t buffer_size)
+{
+    size_t bytes_number;
+    off_t offset;
+
+    if (stream == NULL
+    ||  stream->flvin == NULL
+    ||  stream->state != FLV_STREAM_STATE_TAG_BODY)
+    {
+        std_log_error("some error occur");
+        return 0;
+    }
+
+    offset = ftello(stream->flvin);
+    bytes_number = (buffer_size > stream->current_tag_body_length) ? stream->current_tag_body_length : buffer_size;
+    bytes_number = fread(buffer, sizeof(byte), bytes_number, stream->flvin);
+    fseeko(stream->flvin, offset, SEEK_SET);
+
+    return bytes_number;
+}
+
+
 off_t
 flv_get_current_tag_offset(flv_stream_t * stream) {
      return (stream != NULL) ? stream->current_tag_offset : 0;
@@ -392,22 +424,15 @@ flv_close(flv_stream_t * stream)
 size_t 
 flv_copy_header(void * to, const flv_header_t * header, size_t buffer_size)
 {
-    char * out = to;
+    u_byte * out = to;
     if (buffer_size < FLV_HEADER_SIZE) {
         return 0;
     }
 
-    // memcpy(out, &header->signature, sizeof(header->signature));
-    // out += sizeof(header->signature);
-    out += 3;
-
-    memcpy(out, &header->version, sizeof(header->version));
-    out += sizeof(header->version);
-
-    memcpy(out, &header->flags, sizeof(header->flags));
-    out += sizeof(header->flags);
-
-    memcpy(out, &header->offset, sizeof(header->offset));
+    memcpy(out, FLV_SIGNATURE, 3);
+    out[3] = header->version;
+    out[4] = header->flags;
+    store_u_int32_be(out + 5, header->offset);
 
     return FLV_HEADER_SIZE;
 }
@@ -416,24 +441,17 @@ flv_copy_header(void * to, const flv_header_t * header, size_t buffer_size)
 size_t 
 flv_copy_tag(void * to, const flv_tag_header_t * tag, size_t buffer_size)
 {
-    char * out = to;
+    u_byte * out = to;
     if (buffer_size < FLV_TAG_SIZE) {
         return 0;
     }
 
-    memcpy(out, &tag->tag_type, sizeof(tag->tag_type));
-    out += sizeof(tag->tag_type);
-
-    memcpy(out, &tag->body_length, sizeof(tag->body_length));
-    out += sizeof(tag->body_length);
-
-    memcpy(out, &tag->timestamp, sizeof(tag->timestamp));
-    out += sizeof(tag->timestamp);
-
-    memcpy(out, &tag->timestamp_ex, sizeof(tag->timestamp_ex));
-    out += sizeof(tag->timestamp_ex);
-
-    memcpy(out, &tag->stream_ID, sizeof(tag->stream_ID));
+    /* 24 bits fields are big-endian */
+    out[0] = tag->tag_type;
+    store_u_int24_be(out + 1, tag->body_length);
+    store_u_int24_be(out + 4, tag->timestamp);
+    out[7] = tag->timestamp_ex;
+    store_u_int24_be(out + 8, tag->stream_ID);
 
     return FLV_TAG_SIZE;
 }
@@ -442,13 +460,11 @@ flv_copy_tag(void * to, const flv_tag_header_t * tag, size_t buffer_size)
 size_t 
 flv_copy_prev_tag_size(void * to, u_int prev_tag_size, size_t buffer_size)
 {
-    u_int pts = prev_tag_size;
-
     if (buffer_size < sizeof(u_int)) {
         return 0;
     }
 
-    memcpy(to, &pts, sizeof(u_int));
+    store_u_int32_be(to, prev_tag_size);
 
     return sizeof(u_int);
 }
@@ -458,32 +474,44 @@ flv_copy_prev_tag_size(void * to, u_int prev_tag_size, size_t buffer_size)
 size_t 
 flv_write_header(FILE * out, const flv_header_t * header)
 {
-    if (fwrite(FLV_SIGNATURE, 3, 1, out) == 0)
-        return 0;
-    if (fwrite(&header->version, sizeof(header->version), 1, out) == 0)
-        return 0;
-    if (fwrite(&header->flags, sizeof(header->flags), 1, out) == 0)
-        return 0;
-    if (fwrite(&header->offset, sizeof(header->offset), 1, out) == 0)
-        return 0;
-    return 1;
+    u_byte buffer[FLV_HEADER_SIZE];
+    flv_copy_header(buffer, header, sizeof(buffer));
+    return fwrite(buffer, sizeof(buffer), 1, out);
 }
 
 
 size_t 
 flv_write_tag(FILE * out, const flv_tag_header_t * tag)
 {
-    if (fwrite(&tag->tag_type, sizeof(tag->tag_type), 1, out) == 0)
-        return 0;
-    if (fwrite(&tag->body_length, sizeof(tag->body_length), 1, out) == 0)
-        return 0;
-    if (fwrite(&tag->timestamp, sizeof(tag->timestamp), 1, out) == 0)
-        return 0;
-    if (fwrite(&tag->timestamp_ex, sizeof(tag->timestamp_ex), 1, out) == 0)
-        return 0;
-    if (fwrite(&tag->stream_ID, sizeof(tag->stream_ID), 1, out) == 0)
-        return 0;
-    return 1;
+    u_byte buffer[FLV_TAG_SIZE];
+    flv_copy_tag(buffer, tag, sizeof(buffer));
+    return fwrite(buffer, sizeof(buffer), 1, out);
+}
+
+
+size_t
+flv_write_prev_tag_size(FILE * out, u_int prev_tag_size)
+{
+    u_byte buffer[sizeof(u_int)];
+    flv_copy_prev_tag_size(buffer, prev_tag_size, sizeof(buffer));
+    return fwrite(buffer, sizeof(buffer), 1, out);
+}
+
+
+/* write a whole tag: header, body and the following previous tag size, user_data is a FILE * */
+int
+flv_write_tag_proc(flv_tag_header_t * tag, const void * body, void * user_data)
+{
+    FILE * out = (FILE *) user_data;
+
+    if (flv_write_tag(out, tag) == 0
+    ||  (tag->body_length > 0 && fwrite(body, tag->body_length, 1, out) == 0)
+    ||  flv_write_prev_tag_size(out, FLV_TAG_SIZE + tag->body_length) == 0)
+    {
+        std_log_error("write tag failed");
+        return FLV_ERROR_OPEN_WRITE;
+    }
+    return FLV_OK;
 }
 
 
@@ -634,3 +662,124 @@ flv_parse(const char * file, flv_parser_t * parser)
 
 
 
+
+
+/* FLV tag header walk */
+size_t
+flv_decode_tag_info(const void * from, size_t buffer_size, u_int64 offset, flv_tag_info_t * info)
+{
+    const u_byte * in = from;
+    if (buffer_size < FLV_TAG_SIZE) {
+        return 0;
+    }
+
+    info->offset        = offset;
+    info->tag_type      = in[0];
+    info->body_length   = load_u_int24_be(in + 1);
+    info->timestamp     = load_u_int24_be(in + 4) | ((u_int) in[7] << 24);
+    info->flags         = (info->body_length > 0 && buffer_size > FLV_TAG_SIZE) ? in[FLV_TAG_SIZE] : 0;
+    info->packet_type   = (info->body_length > 1 && buffer_size > FLV_TAG_SIZE + 1) ? in[FLV_TAG_SIZE + 1] : 0;
+
+    return FLV_TAG_SIZE;
+}
+
+
+flv_code
+flv_walk(const char * file, flv_walk_proc walk_proc, void * user_data)
+{
+    FILE * in;
+    u_byte buffer[FLV_TAG_INFO_PEEK_SIZE];
+    flv_tag_info_t info;
+    off_t offset;
+    size_t n;
+    int e;
+
+    if (walk_proc == NULL) {
+        return FLV_ERROR_NULL_POINTER;
+    }
+
+    in = fopen(file, "rb");
+    if (in == NULL) {
+        std_log_error("file open failed: %s", file);
+        return FLV_ERROR_OPEN;
+    }
+
+    if (fread(buffer, FLV_HEADER_SIZE, 1, in) == 0) {
+        std_log_error("file read failed: %s", file);
+        fclose(in);
+        return FLV_ERROR_OPEN_READ;
+    }
+
+    if (memcmp(buffer, FLV_SIGNATURE, 3) != 0) {
+        std_log_error("Illegal flv file: %s", file);
+        fclose(in);
+        return FLV_ERROR_NO_FLV;
+    }
+
+    /* skip the header and the first previous tag size */
+    offset = (off_t) load_u_int32_be(buffer + 5);
+    if (offset < (off_t) FLV_HEADER_SIZE) {
+        offset = FLV_HEADER_SIZE;
+    }
+    offset += sizeof(u_int);
+
+    /* only the tag header and the first two body bytes are read, bodies are skipped */
+    while (fseeko(in, offset, SEEK_SET) == 0) {
+        n = fread(buffer, sizeof(u_byte), sizeof(buffer), in);
+        if (flv_decode_tag_info(buffer, n, (u_int64) offset, &info) == 0) {
+            break;
+        }
+
+        e = walk_proc(&info, user_data);
+        if (e != FLV_OK) {
+            fclose(in);
+            return (flv_code) e;
+        }
+
+        offset += FLV_TAG_SIZE + info.body_length + sizeof(u_int);
+    }
+
+    fclose(in);
+    return FLV_OK;
+}
+
+
+/* same walk over a file loaded or mapped in memory */
+flv_code
+flv_walk_buffer(const void * buffer, size_t buffer_size, flv_walk_proc walk_proc, void * user_data)
+{
+    const u_byte * in = buffer;
+    flv_tag_info_t info;
+    u_int64 offset;
+    int e;
+
+    if (in == NULL || walk_proc == NULL) {
+        return FLV_ERROR_NULL_POINTER;
+    }
+
+    if (buffer_size < FLV_HEADER_SIZE || memcmp(in, FLV_SIGNATURE, 3) != 0) {
+        std_log_error("Illegal flv buffer");
+        return FLV_ERROR_NO_FLV;
+    }
+
+    offset = load_u_int32_be(in + 5);
+    if (offset < FLV_HEADER_SIZE) {
+        offset = FLV_HEADER_SIZE;
+    }
+    offset += sizeof(u_int);
+
+    while (offset < buffer_size) {
+        if (flv_decode_tag_info(in + offset, buffer_size - offset, offset, &info) == 0) {
+            break;
+        }
+
+        e = walk_proc(&info, user_data);
+        if (e != FLV_OK) {
+            return (flv_code) e;
+        }
+
+        offset += FLV_TAG_SIZE + info.body_length + sizeof(u_int);
+    }
+
+    return FLV_OK;
+}
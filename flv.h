@@ -55,10 +55,19 @@ typedef struct flv_tag_header_s {
 
 #define FLV_TAG_SIZE 11u
 
+/*
+ * flv_read_metadata() decodes script tags within these limits, and with no more values
+ * than the tag body has bytes: each value takes one at least.
+ */
+#define FLV_METADATA_MAX_DEPTH      32
+#define FLV_METADATA_MAX_BYTES      (64u * 1024 * 1024)
+
 #define flv_tag_get_body_length(tag)    ((u_int) (tag)->body_length)
 #define flv_tag_get_stream_ID(tag)      ((u_int) (tag)->stream_ID)
 #define flv_tag_get_timestamp(tag) \
-    ((u_int) (tag)->timestamp) + ((tag)->timestamp_ex << 24))
+    (((u_int) (tag)->timestamp & 0xFFFFFF) | ((u_int) (tag)->timestamp_ex << 24))
+#define flv_tag_set_timestamp(tag, ts) \
+    do { (tag)->timestamp = (u_int) (ts) & 0xFFFFFF; (tag)->timestamp_ex = (u_byte) ((u_int) (ts) >> 24); } while (0)
 
 #define format_tag_header(tag)    \
     printf("{ tag_type:%d, body_length:%d, stream_ID:%d, timestamp:%d, timestamp_ex:%d", tag->tag_type, tag->body_length, tag->stream_ID, tag->timestamp, tag->timestamp_ex)
@@ -168,6 +177,7 @@ flv_code    flv_read_audio_tag(flv_stream_t * stream, flv_audio_tag * tag);
 flv_code    flv_read_video_tag(flv_stream_t * stream, flv_video_tag * tag);
 flv_code    flv_read_metadata(flv_stream_t * stream, amf_data_t ** name, amf_data_t ** data);
 size_t      flv_read_tag_body(flv_stream_t * stream, void * buffer, size_t buffer_size);
+size_t      flv_peek_tag_body(flv_stream_t * stream, void * buffer, size_t buffer_size);
 off_t       flv_get_current_tag_offset(flv_stream_t * stream);
 off_t       flv_get_offset(flv_stream_t * stream);
 void        flv_reset(flv_stream_t * stream);
@@ -183,6 +193,14 @@ size_t      flv_copy_prev_tag_size(void * to, u_int prev_tag_size, size_t buffer
 /* FLV stdio writing helper functions */
 size_t      flv_write_header(FILE * out, const flv_header_t * header);
 size_t      flv_write_tag(FILE * out, const flv_tag_header_t * tag);
+size_t      flv_write_prev_tag_size(FILE * out, u_int prev_tag_size);
+
+
+/* FLV tag sink, used to chain tag processing stages */
+typedef int (* flv_tag_proc)(flv_tag_header_t * tag, const void * body, void * user_data);
+
+/* flv_tag_proc writing whole tags into the FILE * given as user_data */
+int         flv_write_tag_proc(flv_tag_header_t * tag, const void * body, void * user_data);
 
 
 /* FLV event based parser */
@@ -204,6 +222,34 @@ typedef struct flv_parser_s {
 flv_code flv_parse(const char * file, flv_parser_t * parser);
 
 
+/* FLV tag header walk, touches only tag headers and the first body bytes */
+typedef struct flv_tag_info_s {
+    u_int64     offset;         // file offset of the tag header
+    u_int       body_length;    // body length, in bytes
+    u_int       timestamp;      // full 32 bits timestamp (timestamp_ex as high byte), in milliseconds
+    u_byte      tag_type;       // one of: 8：audio，9：video，18：metadata
+    u_byte      flags;          // first body byte: flv_audio_tag / flv_video_tag, 0 if body is empty
+    u_byte      packet_type;    // second body byte: AVC / AAC packet type, 0 if missing
+} flv_tag_info_t;
+
+#define FLV_TAG_INFO_PEEK_SIZE  (FLV_TAG_SIZE + 2u)
+
+#define flv_tag_info_is_video_frame(info) \
+    ((info)->tag_type == FLV_TAG_HEADER_TYPE_VIDEO && (info)->body_length > 0 \
+    && flv_video_tag_frame_type((info)->flags) != FLV_VIDEO_TAG_FRAME_TYPE_COMMAND_FRAME \
+    && !(flv_video_tag_codec_id((info)->flags) == FLV_VIDEO_TAG_CODEC_AVC \
+        && (info)->packet_type != FLV_AVC_PACKET_TYPE_NALU))
+#define flv_tag_info_is_keyframe(info) \
+    (flv_tag_info_is_video_frame(info) \
+    && flv_video_tag_frame_type((info)->flags) == FLV_VIDEO_TAG_FRAME_TYPE_KEYFRAME)
+
+typedef int (* flv_walk_proc)(const flv_tag_info_t * info, void * user_data);
+
+size_t      flv_decode_tag_info(const void * from, size_t buffer_size, u_int64 offset, flv_tag_info_t * info);
+flv_code    flv_walk(const char * file, flv_walk_proc walk_proc, void * user_data);
+flv_code    flv_walk_buffer(const void * buffer, size_t buffer_size, flv_walk_proc walk_proc, void * user_data);
+
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,264 @@
+#include "flv_cue.h"
+
+#include <string.h>
+
+
+static void
+flv_cue_index_init(flv_cue_index_t * index)
+{
+    memset(index, 0, sizeof(flv_cue_index_t));
+}
+
+
+/* script tags are kept as they come, named and sorted once the walk is over */
+static int
+flv_cue_walk(const flv_tag_info_t * info, void * user_data)
+{
+    flv_cue_index_t * index = (flv_cue_index_t*) user_data;
+    flv_cue_t * cue;
+
+    if (info->tag_type != FLV_TAG_HEADER_TYPE_META) {
+        return FLV_OK;
+    }
+
+    if (index->count == index->capacity) {
+        size_t capacity = (index->capacity > 0) ? index->capacity * 2 : FLV_CUE_INITIAL_CAPACITY;
+        flv_cue_t * cues = (flv_cue_t*) realloc(index->cues, capacity * sizeof(flv_cue_t));
+        if (cues == NULL) {
+            std_log_error("alloc memory failed");
+            return FLV_ERROR_MEMORY;
+        }
+        index->cues = cues;
+        index->capacity = capacity;
+    }
+
+    cue = &index->cues[index->count++];
+    memset(cue, 0, sizeof(flv_cue_t));
+    cue->offset = info->offset;
+    cue->body_length = info->body_length;
+    cue->timestamp = info->timestamp;
+    return FLV_OK;
+}
+
+
+/* the AMF string starting the body, of which n bytes are at hand */
+static void
+flv_cue_set_name(flv_cue_t * cue, const u_byte * body, size_t n)
+{
+    size_t size;
+
+    if (n < 3 || body[0] != AMF_TYPE_STRING) {
+        return;
+    }
+    cue->name_size = load_u_int16_be(body + 1);
+    size = (cue->name_size < FLV_CUE_NAME_MAX) ? cue->name_size : FLV_CUE_NAME_MAX;
+    if (size > n - 3) {
+        size = n - 3;
+    }
+    memcpy(cue->name, body + 3, size);
+    cue->name[size] = '\0';
+}
+
+
+static int
+flv_cue_compare(const void * a, const void * b)
+{
+    const flv_cue_t * x = (const flv_cue_t*) a, * y = (const flv_cue_t*) b;
+
+    if (x->timestamp != y->timestamp) {
+        return (x->timestamp < y->timestamp) ? -1 : 1;
+    }
+    return (x->offset < y->offset) ? -1 : (x->offset > y->offset);
+}
+
+
+/* read the names, drop onMetaData and the events not matching, then sort */
+static flv_code
+flv_cue_index_names(flv_cue_index_t * index, const char * name)
+{
+    u_byte head[3 + FLV_CUE_NAME_MAX];
+    const u_byte * body;
+    size_t i, n, kept = 0, name_size = (name != NULL) ? strlen(name) : 0;
+    FILE * in = NULL;
+    flv_cue_t * cue;
+
+    if (index->file != NULL && index->count > 0 && (in = fopen(index->file, "rb")) == NULL) {
+        std_log_error("file open failed: %s", index->file);
+        return FLV_ERROR_OPEN;
+    }
+
+    for (i = 0; i < index->count; ++i) {
+        cue = &index->cues[i];
+        n = (cue->body_length < sizeof(head)) ? cue->body_length : sizeof(head);
+        if (in != NULL) {
+            body = head;
+            if (fseeko(in, (off_t) (cue->offset + FLV_TAG_SIZE), SEEK_SET) != 0) {
+                n = 0;
+            } else {
+                n = fread(head, 1, n, in);
+            }
+        } else {
+            body = index->buffer + cue->offset + FLV_TAG_SIZE;
+            if (cue->offset + FLV_TAG_SIZE + n > index->buffer_size) {
+                n = (cue->offset + FLV_TAG_SIZE < index->buffer_size) ? index->buffer_size - (cue->offset + FLV_TAG_SIZE) : 0;
+            }
+        }
+        flv_cue_set_name(cue, body, n);
+
+        if (name != NULL) {
+            if (cue->name_size != name_size || name_size > FLV_CUE_NAME_MAX || memcmp(cue->name, name, name_size) != 0) {
+                continue;
+            }
+        } else if (cue->name_size == 10 && memcmp(cue->name, "onMetaData", 10) == 0) {
+            continue;
+        }
+        index->cues[kept++] = *cue;
+    }
+    index->count = kept;
+
+    if (in != NULL) {
+        fclose(in);
+    }
+    qsort(index->cues, index->count, sizeof(flv_cue_t), flv_cue_compare);
+    return FLV_OK;
+}
+
+
+flv_code
+flv_cue_index_file(const char * file, flv_cue_index_t * index, const char * name)
+{
+    size_t size = strlen(file) + 1;
+    flv_code e;
+
+    flv_cue_index_init(index);
+    if ((index->file = (char*) malloc(size)) == NULL) {
+        std_log_error("alloc memory failed");
+        return FLV_ERROR_MEMORY;
+    }
+    memcpy(index->file, file, size);
+
+    if ((e = flv_walk(file, flv_cue_walk, index)) != FLV_OK) {
+        return e;
+    }
+    return flv_cue_index_names(index, name);
+}
+
+
+flv_code
+flv_cue_index_buffer(const void * buffer, size_t buffer_size, flv_cue_index_t * index, const char * name)
+{
+    flv_code e;
+
+    flv_cue_index_init(index);
+    index->buffer = (const u_byte*) buffer;
+    index->buffer_size = buffer_size;
+
+    if ((e = flv_walk_buffer(buffer, buffer_size, flv_cue_walk, index)) != FLV_OK) {
+        return e;
+    }
+    return flv_cue_index_names(index, name);
+}
+
+
+void
+flv_cue_index_free(flv_cue_index_t * index)
+{
+    if (index != NULL) {
+        free(index->cues);
+        free(index->file);
+        flv_cue_index_init(index);
+    }
+}
+
+
+/* first cue with a timestamp above, or at if inclusive */
+static size_t
+flv_cue_search(const flv_cue_index_t * index, u_int timestamp, int inclusive)
+{
+    size_t low = 0, high = index->count, middle;
+    u_int t;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        t = index->cues[middle].timestamp;
+        if (t < timestamp || (!inclusive && t == timestamp)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+
+const flv_cue_t *
+flv_cue_next(const flv_cue_index_t * index, u_int timestamp)
+{
+    size_t i = flv_cue_search(index, timestamp, 1);
+    return (i < index->count) ? &index->cues[i] : NULL;
+}
+
+
+const flv_cue_t *
+flv_cue_prev(const flv_cue_index_t * index, u_int timestamp)
+{
+    size_t i = flv_cue_search(index, timestamp, 0);
+    return (i > 0) ? &index->cues[i - 1] : NULL;
+}
+
+
+flv_code
+flv_cue_payload(const flv_cue_index_t * index, const flv_cue_t * cue, amf_data_t ** data)
+{
+    amf_limits_t limits;
+    u_byte * body = NULL;
+    const u_byte * p;
+    size_t skip;
+    FILE * in;
+    amf_code e;
+
+    *data = NULL;
+    if (index->file != NULL) {
+        if ((in = fopen(index->file, "rb")) == NULL) {
+            std_log_error("file open failed: %s", index->file);
+            return FLV_ERROR_OPEN;
+        }
+        if ((body = (u_byte*) malloc(cue->body_length + 1)) == NULL) {
+            fclose(in);
+            return FLV_ERROR_MEMORY;
+        }
+        if (fseeko(in, (off_t) (cue->offset + FLV_TAG_SIZE), SEEK_SET) != 0
+        ||  fread(body, 1, cue->body_length, in) != cue->body_length)
+        {
+            free(body);
+            fclose(in);
+            return FLV_ERROR_EOF;
+        }
+        fclose(in);
+    } else if (cue->offset + FLV_TAG_SIZE + cue->body_length > index->buffer_size) {
+        return FLV_ERROR_EOF;
+    }
+
+    /* the value after the name, within the limits of flv_read_metadata() */
+    p = (body != NULL) ? body : index->buffer + cue->offset + FLV_TAG_SIZE;
+    skip = 0;
+    if (cue->body_length >= 3 && p[0] == AMF_TYPE_STRING) {
+        skip = 3 + (size_t) load_u_int16_be(p + 1);
+        if (skip > cue->body_length) {
+            skip = cue->body_length;
+        }
+    }
+    limits.max_depth = FLV_METADATA_MAX_DEPTH;
+    limits.max_elements = cue->body_length;
+    limits.max_bytes = FLV_METADATA_MAX_BYTES;
+    *data = amf_data_buffer_read_limited((byte*) p + skip, cue->body_length - skip, NULL, &limits);
+    free(body);
+
+    e = amf_data_get_error_code(*data);
+    if (*data == NULL || e != AMF_ERROR_OK) {
+        amf_data_free(*data);
+        *data = NULL;
+        return (e == AMF_ERROR_EOF) ? FLV_ERROR_EOF : FLV_ERROR_INVALID_METADATA;
+    }
+    return FLV_OK;
+}
@@ -0,0 +1,70 @@
+#ifndef __FLV_CUE_H__
+#define __FLV_CUE_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "amf.h"
+#include "flv.h"
+
+
+
+
+/*
+ * Index of the script events of a file (onCuePoint, onTextData, onCaption...), every
+ * script tag but onMetaData, or only the ones of a given name. It is built with a header
+ * walk, then the names are read from the first body bytes; payloads are decoded on
+ * demand with flv_cue_payload().
+ *
+ * Cues are sorted by timestamp, then file order: the cue around a time is found with a
+ * binary search, and the ones after or before it are its neighbours in the array.
+ */
+
+#define FLV_CUE_NAME_MAX            31
+#define FLV_CUE_INITIAL_CAPACITY    64
+
+typedef struct flv_cue_s {
+    u_int64     offset;                         // file offset of the tag header
+    u_int       body_length;
+    u_int       timestamp;
+    u_short     name_size;                      // full size, name is cut past FLV_CUE_NAME_MAX
+    char        name[FLV_CUE_NAME_MAX + 1];     // NUL terminated, empty if the body has none
+} flv_cue_t;
+
+typedef struct flv_cue_index_s {
+    flv_cue_t      *cues;
+    size_t          count;
+    size_t          capacity;
+    const u_byte   *buffer;         // payloads are read from the buffer indexed,
+    size_t          buffer_size;
+    char           *file;           // or from the file
+} flv_cue_index_t;
+
+#define flv_cue_index_size(index)   ((index)->count)
+#define flv_cue_index_get(index, i) (&(index)->cues[(i)])
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* name NULL for every event, the buffer must outlive the index */
+flv_code            flv_cue_index_file(const char * file, flv_cue_index_t * index, const char * name);
+flv_code            flv_cue_index_buffer(const void * buffer, size_t buffer_size, flv_cue_index_t * index, const char * name);
+void                flv_cue_index_free(flv_cue_index_t * index);
+
+/* first cue at or after timestamp, last one at or before it; NULL if none, O(log n) */
+const flv_cue_t *   flv_cue_next(const flv_cue_index_t * index, u_int timestamp);
+const flv_cue_t *   flv_cue_prev(const flv_cue_index_t * index, u_int timestamp);
+
+/* decode the value following the event name, to be released with amf_data_free() */
+flv_code            flv_cue_payload(const flv_cue_index_t * index, const flv_cue_t * cue, amf_data_t ** data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_CUE_H__ */
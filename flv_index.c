@@ -0,0 +1,64 @@
+#include "flv_index.h"
+
+
+void
+flv_index_init(flv_index_t * index)
+{
+    index->tags = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+
+
+flv_code
+flv_index_add(flv_index_t * index, const flv_tag_info_t * info)
+{
+    if (index->count == index->capacity) {
+        size_t capacity = (index->capacity > 0) ? index->capacity * 2 : FLV_INDEX_INITIAL_CAPACITY;
+        flv_tag_info_t * tags = (flv_tag_info_t*) realloc(index->tags, capacity * sizeof(flv_tag_info_t));
+        if (tags == NULL) {
+            std_log_error("alloc memory failed");
+            return FLV_ERROR_MEMORY;
+        }
+        index->tags = tags;
+        index->capacity = capacity;
+    }
+
+    memcpy(&index->tags[index->count++], info, sizeof(flv_tag_info_t));
+    return FLV_OK;
+}
+
+
+static int
+flv_index_walk(const flv_tag_info_t * info, void * user_data)
+{
+    return flv_index_add((flv_index_t *) user_data, info);
+}
+
+
+/* build the index with a header walk over a file */
+flv_code
+flv_index_file(const char * file, flv_index_t * index)
+{
+    flv_index_init(index);
+    return flv_walk(file, flv_index_walk, index);
+}
+
+
+/* build the index over a file loaded or mapped in memory */
+flv_code
+flv_index_buffer(const void * buffer, size_t buffer_size, flv_index_t * index)
+{
+    flv_index_init(index);
+    return flv_walk_buffer(buffer, buffer_size, flv_index_walk, index);
+}
+
+
+void
+flv_index_free(flv_index_t * index)
+{
+    if (index != NULL) {
+        free(index->tags);
+        flv_index_init(index);
+    }
+}
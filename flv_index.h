@@ -0,0 +1,42 @@
+#ifndef __FLV_INDEX_H__
+#define __FLV_INDEX_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "flv.h"
+
+
+
+
+/* FLV tag index, one flv_tag_info_t per tag in file order */
+typedef struct flv_index_s {
+    flv_tag_info_t     *tags;
+    size_t              count;
+    size_t              capacity;
+} flv_index_t;
+
+#define FLV_INDEX_INITIAL_CAPACITY  1024
+
+#define flv_index_size(index)       ((index)->count)
+#define flv_index_get(index, i)     (&(index)->tags[(i)])
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void        flv_index_init(flv_index_t * index);
+flv_code    flv_index_add(flv_index_t * index, const flv_tag_info_t * info);
+flv_code    flv_index_file(const char * file, flv_index_t * index);
+flv_code    flv_index_buffer(const void * buffer, size_t buffer_size, flv_index_t * index);
+void        flv_index_free(flv_index_t * index);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_INDEX_H__ */
@@ -0,0 +1,125 @@
+#include "flv_json.h"
+
+#include <string.h>
+
+
+typedef struct flv_json_writer_s {
+    amf_buffer_t    buffer;
+    FILE           *stream;
+} flv_json_writer_t;
+
+
+/* key given with its punctuation, then an integer */
+static void
+flv_json_field(amf_buffer_t * buffer, const char * key, size_t size, u_int64 value)
+{
+    u_byte * p = amf_buffer_reserve(buffer, size);
+    if (p != NULL) {
+        memcpy(p, key, size);
+        buffer->size += size;
+        amf_json_integer(buffer, value);
+    }
+}
+
+#define flv_json_key(buffer, key, value) \
+    flv_json_field((buffer), (key), sizeof(key) - 1, (u_int64) (value))
+
+
+size_t
+flv_json_tag(const flv_tag_info_t * info, amf_buffer_t * buffer)
+{
+    size_t start = buffer->size;
+    u_byte * p;
+
+    flv_json_key(buffer, "{\"offset\":", info->offset);
+    flv_json_key(buffer, ",\"tag_type\":", info->tag_type);
+    flv_json_key(buffer, ",\"body_length\":", info->body_length);
+    flv_json_key(buffer, ",\"timestamp\":", info->timestamp);
+
+    if (info->body_length > 0) {
+        if (info->tag_type == FLV_TAG_HEADER_TYPE_AUDIO) {
+            flv_json_key(buffer, ",\"sound_format\":", flv_audio_tag_sound_format(info->flags));
+            flv_json_key(buffer, ",\"sound_rate\":", flv_audio_tag_sound_rate(info->flags));
+            flv_json_key(buffer, ",\"sound_size\":", flv_audio_tag_sound_size(info->flags));
+            flv_json_key(buffer, ",\"sound_type\":", flv_audio_tag_sound_type(info->flags));
+            if (flv_audio_tag_sound_format(info->flags) == FLV_AUDIO_TAG_SOUND_FORMAT_AAC && info->body_length > 1) {
+                flv_json_key(buffer, ",\"packet_type\":", info->packet_type);
+            }
+        } else if (info->tag_type == FLV_TAG_HEADER_TYPE_VIDEO) {
+            flv_json_key(buffer, ",\"frame_type\":", flv_video_tag_frame_type(info->flags));
+            flv_json_key(buffer, ",\"codec_id\":", flv_video_tag_codec_id(info->flags));
+            if (flv_video_tag_codec_id(info->flags) == FLV_VIDEO_TAG_CODEC_AVC && info->body_length > 1) {
+                flv_json_key(buffer, ",\"packet_type\":", info->packet_type);
+            }
+        }
+    }
+
+    if ((p = amf_buffer_reserve(buffer, 2)) != NULL) {
+        p[0] = '}';
+        p[1] = '\n';
+        buffer->size += 2;
+    }
+    return buffer->error ? 0 : buffer->size - start;
+}
+
+
+static int
+flv_json_flush(flv_json_writer_t * writer)
+{
+    size_t size = writer->buffer.size;
+
+    amf_buffer_reset(&writer->buffer);
+    if (size > 0 && fwrite(writer->buffer.data, 1, size, writer->stream) != size) {
+        std_log_error("Write error");
+        return FLV_ERROR_OPEN_WRITE;
+    }
+    return FLV_OK;
+}
+
+
+static int
+flv_json_walk(const flv_tag_info_t * info, void * user_data)
+{
+    flv_json_writer_t * writer = (flv_json_writer_t*) user_data;
+
+    if (flv_json_tag(info, &writer->buffer) == 0) {
+        return FLV_ERROR_MEMORY;
+    }
+    if (writer->buffer.size >= FLV_JSON_FLUSH_SIZE) {
+        return flv_json_flush(writer);
+    }
+    return FLV_OK;
+}
+
+
+/* the lines written before an error are kept */
+static flv_code
+flv_json_finish(flv_json_writer_t * writer, flv_code e)
+{
+    int f = flv_json_flush(writer);
+
+    amf_buffer_free(&writer->buffer);
+    return (e != FLV_OK) ? e : (flv_code) f;
+}
+
+
+flv_code
+flv_json_lines(const char * file, FILE * stream)
+{
+    flv_json_writer_t writer;
+
+    amf_buffer_init(&writer.buffer, NULL);
+    writer.stream = stream;
+    return flv_json_finish(&writer, flv_walk(file, flv_json_walk, &writer));
+}
+
+
+flv_code
+flv_json_lines_buffer(const void * buffer, size_t buffer_size, FILE * stream)
+{
+    flv_json_writer_t writer;
+
+    amf_buffer_init(&writer.buffer, NULL);
+    writer.stream = stream;
+    return flv_json_finish(&writer, flv_walk_buffer(buffer, buffer_size, flv_json_walk, &writer));
+}
@@ -0,0 +1,47 @@
+#ifndef __FLV_JSON_H__
+#define __FLV_JSON_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "amf.h"
+#include "amf_json.h"
+#include "flv.h"
+
+
+
+
+/*
+ * JSON lines of a tag stream, one object per tag:
+ *
+ *   {"offset":13,"tag_type":9,"body_length":42,"timestamp":0,"frame_type":1,"codec_id":7,"packet_type":0}
+ *
+ * offset, tag_type, body_length and timestamp are always there. A non empty audio tag
+ * adds sound_format, sound_rate, sound_size and sound_type, a video tag frame_type and
+ * codec_id, and packet_type follows for AAC and AVC. Values are the raw header fields.
+ *
+ * Lines are gathered in a buffer written out every FLV_JSON_FLUSH_SIZE bytes, the walk
+ * reads tag headers only.
+ */
+
+#define FLV_JSON_FLUSH_SIZE     65536
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* append the line of a tag, newline included, returns its size, 0 when out of memory */
+size_t      flv_json_tag(const flv_tag_info_t * info, amf_buffer_t * buffer);
+/* write the lines of every tag into stream */
+flv_code    flv_json_lines(const char * file, FILE * stream);
+flv_code    flv_json_lines_buffer(const void * buffer, size_t buffer_size, FILE * stream);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_JSON_H__ */
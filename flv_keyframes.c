@@ -0,0 +1,260 @@
+#include "flv_keyframes.h"
+
+#include <string.h>
+
+
+#define FLV_KEYFRAMES_HEADER_SIZE   12
+
+
+void
+flv_keyframes_init(flv_keyframes_t * keyframes)
+{
+    memset(keyframes, 0, sizeof(flv_keyframes_t));
+}
+
+
+void
+flv_keyframes_free(flv_keyframes_t * keyframes)
+{
+    if (keyframes != NULL) {
+        free(keyframes->block);
+        flv_keyframes_init(keyframes);
+    }
+}
+
+
+/*
+ * Room for capacity keyframes, a multiple of 8: times and positions both start on a
+ * cache line of one block. Growing moves both arrays to a new block.
+ */
+static flv_code
+flv_keyframes_reserve(flv_keyframes_t * keyframes, size_t capacity)
+{
+    void * block;
+    int64 * times;
+
+    if (capacity <= keyframes->capacity) {
+        return FLV_OK;
+    }
+    capacity = (capacity + 7) & ~(size_t) 7;
+    block = malloc(capacity * (sizeof(int64) + sizeof(u_int64)) + FLV_KEYFRAMES_ALIGNMENT);
+    if (block == NULL) {
+        std_log_error("alloc memory failed");
+        return FLV_ERROR_MEMORY;
+    }
+
+    times = (int64*) (((size_t) block + FLV_KEYFRAMES_ALIGNMENT - 1) & ~(size_t) (FLV_KEYFRAMES_ALIGNMENT - 1));
+    if (keyframes->count > 0) {
+        memcpy(times, keyframes->times, keyframes->count * sizeof(int64));
+        memcpy(times + capacity, keyframes->positions, keyframes->count * sizeof(u_int64));
+    }
+    free(keyframes->block);
+    keyframes->block = block;
+    keyframes->times = times;
+    keyframes->positions = (u_int64*) (times + capacity);
+    keyframes->capacity = capacity;
+    return FLV_OK;
+}
+
+
+flv_code
+flv_keyframes_add(flv_keyframes_t * keyframes, int64 time, u_int64 position)
+{
+    size_t capacity;
+    flv_code e;
+
+    if (keyframes->count > 0 && time < keyframes->times[keyframes->count - 1]) {
+        return FLV_OK;
+    }
+    if (keyframes->count == keyframes->capacity) {
+        capacity = (keyframes->capacity > 0) ? keyframes->capacity * 2 : FLV_KEYFRAMES_INITIAL_CAPACITY;
+        if ((e = flv_keyframes_reserve(keyframes, capacity)) != FLV_OK) {
+            return e;
+        }
+    }
+    keyframes->times[keyframes->count] = time;
+    keyframes->positions[keyframes->count] = position;
+    ++(keyframes->count);
+    return FLV_OK;
+}
+
+
+flv_code
+flv_keyframes_from_meta(flv_keyframes_t * keyframes, const flv_meta_t * meta)
+{
+    size_t i, count;
+    double time;
+    flv_code e;
+
+    flv_keyframes_init(keyframes);
+    if (!(meta->fields & FLV_META_KEYFRAMES) || meta->keyframe_times == NULL || meta->keyframe_positions == NULL) {
+        return FLV_ERROR_INVALID_METADATA;
+    }
+
+    count = (meta->keyframe_count < meta->keyframe_capacity) ? meta->keyframe_count : meta->keyframe_capacity;
+    if ((e = flv_keyframes_reserve(keyframes, count)) != FLV_OK) {
+        return e;
+    }
+    for (i = 0; i < count; ++i) {
+        /* NaN for the entries which were not numbers */
+        time = meta->keyframe_times[i] * 1000.0;
+        if (time != time || meta->keyframe_positions[i] != meta->keyframe_positions[i]
+        ||  time < 0 || meta->keyframe_positions[i] < 0)
+        {
+            continue;
+        }
+        flv_keyframes_add(keyframes, (int64) (time + 0.5), (u_int64) meta->keyframe_positions[i]);
+    }
+    return FLV_OK;
+}
+
+
+flv_code
+flv_keyframes_from_index(flv_keyframes_t * keyframes, const flv_index_t * index)
+{
+    const flv_tag_info_t * info;
+    size_t i;
+    flv_code e;
+
+    flv_keyframes_init(keyframes);
+    for (i = 0; i < flv_index_size(index); ++i) {
+        info = flv_index_get(index, i);
+        if (flv_tag_info_is_keyframe(info)
+        &&  (e = flv_keyframes_add(keyframes, (int64) info->timestamp, info->offset)) != FLV_OK)
+        {
+            return e;
+        }
+    }
+    return FLV_OK;
+}
+
+
+flv_code
+flv_keyframes_load(flv_keyframes_t * keyframes, const char * file)
+{
+    u_byte header[FLV_KEYFRAMES_HEADER_SIZE];
+    size_t i, count, kept;
+    off_t size;
+    FILE * in;
+    flv_code e;
+
+    flv_keyframes_init(keyframes);
+    if ((in = fopen(file, "rb")) == NULL) {
+        std_log_error("file open failed: %s", file);
+        return FLV_ERROR_OPEN;
+    }
+    if (fread(header, FLV_KEYFRAMES_HEADER_SIZE, 1, in) != 1
+    ||  memcmp(header, FLV_KEYFRAMES_SIGNATURE, 4) != 0
+    ||  load_u_int32_be(header + 4) != FLV_KEYFRAMES_VERSION)
+    {
+        std_log_error("Illegal keyframes file: %s", file);
+        fclose(in);
+        return FLV_ERROR_NO_FLV;
+    }
+
+    /* the count must match the file size before anything is allocated */
+    count = load_u_int32_be(header + 8);
+    if (fseeko(in, 0, SEEK_END) != 0
+    ||  (size = ftello(in)) != (off_t) (FLV_KEYFRAMES_HEADER_SIZE + (u_int64) count * (sizeof(int64) + sizeof(u_int64)))
+    ||  fseeko(in, FLV_KEYFRAMES_HEADER_SIZE, SEEK_SET) != 0)
+    {
+        std_log_error("Illegal keyframes file: %s", file);
+        fclose(in);
+        return FLV_ERROR_EOF;
+    }
+
+    if ((e = flv_keyframes_reserve(keyframes, count)) != FLV_OK) {
+        fclose(in);
+        return e;
+    }
+    if (count > 0
+    &&  (fread(keyframes->times, sizeof(int64), count, in) != count
+    ||  fread(keyframes->positions, sizeof(u_int64), count, in) != count))
+    {
+        std_log_error("file read failed: %s", file);
+        fclose(in);
+        flv_keyframes_free(keyframes);
+        return FLV_ERROR_OPEN_READ;
+    }
+    fclose(in);
+
+    /* big endian in place, times going backwards are dropped as by flv_keyframes_add() */
+    for (i = 0, kept = 0; i < count; ++i) {
+        keyframes->times[kept] = (int64) load_u_int64_be(keyframes->times + i);
+        keyframes->positions[kept] = load_u_int64_be(keyframes->positions + i);
+        if (kept == 0 || keyframes->times[kept] >= keyframes->times[kept - 1]) {
+            ++kept;
+        }
+    }
+    keyframes->count = kept;
+    return FLV_OK;
+}
+
+
+flv_code
+flv_keyframes_save(const flv_keyframes_t * keyframes, const char * file)
+{
+    u_byte buffer[FLV_KEYFRAMES_HEADER_SIZE + 64 * sizeof(u_int64)];
+    size_t i, n;
+    u_int64 v;
+    FILE * out;
+    int pass;
+
+    if (keyframes->count > 0xFFFFFFFFu) {
+        return FLV_ERROR_MEMORY;
+    }
+    if ((out = fopen(file, "wb")) == NULL) {
+        std_log_error("file open failed: %s", file);
+        return FLV_ERROR_OPEN_WRITE;
+    }
+
+    memcpy(buffer, FLV_KEYFRAMES_SIGNATURE, 4);
+    store_u_int32_be(buffer + 4, FLV_KEYFRAMES_VERSION);
+    store_u_int32_be(buffer + 8, (u_int) keyframes->count);
+    n = FLV_KEYFRAMES_HEADER_SIZE;
+
+    /* times, then positions, through a small buffer */
+    for (pass = 0; pass < 2; ++pass) {
+        for (i = 0; i < keyframes->count; ++i) {
+            v = (pass == 0) ? (u_int64) keyframes->times[i] : keyframes->positions[i];
+            store_u_int32_be(buffer + n, (u_int) (v >> 32));
+            store_u_int32_be(buffer + n + 4, (u_int) v);
+            n += sizeof(u_int64);
+            if (n + sizeof(u_int64) > sizeof(buffer)) {
+                if (fwrite(buffer, 1, n, out) != n) {
+                    fclose(out);
+                    return FLV_ERROR_OPEN_WRITE;
+                }
+                n = 0;
+            }
+        }
+    }
+    if ((n > 0 && fwrite(buffer, 1, n, out) != n) || fclose(out) != 0) {
+        std_log_error("file write failed: %s", file);
+        return FLV_ERROR_OPEN_WRITE;
+    }
+    return FLV_OK;
+}
+
+
+/*
+ * Branchless binary search: the range halves whatever the comparison, which only picks
+ * the lower or upper half (a conditional move), so the loop runs log2(count) times with
+ * no branch to mispredict.
+ */
+size_t
+flv_keyframes_find(const flv_keyframes_t * keyframes, int64 time)
+{
+    const int64 * base = keyframes->times;
+    size_t n = keyframes->count, half;
+
+    if (n == 0 || time < base[0]) {
+        return FLV_KEYFRAMES_NONE;
+    }
+    while (n > 1) {
+        half = n / 2;
+        base = (base[half] <= time) ? base + half : base;
+        n -= half;
+    }
+    return (size_t) (base - keyframes->times);
+}
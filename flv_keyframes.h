@@ -0,0 +1,65 @@
+#ifndef __FLV_KEYFRAMES_H__
+#define __FLV_KEYFRAMES_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "flv.h"
+#include "flv_index.h"
+#include "flv_meta.h"
+
+
+
+
+/*
+ * Keyframe table for seeks: times (in milliseconds) and file positions in two plain
+ * arrays, each aligned on a cache line, instead of the AMF arrays of onMetaData. The
+ * keyframe at or before a time is found with a branchless binary search over times.
+ *
+ * The table is filled from onMetaData (see flv_meta.h), from a tag index, or loaded from
+ * a sidecar file written by flv_keyframes_save(): "FLVK", a 32 bits version and count,
+ * then the times and the positions, all big endian. Times never go backwards: a
+ * keyframe earlier than the one before it could never be found, it is dropped.
+ */
+
+#define FLV_KEYFRAMES_ALIGNMENT         64
+#define FLV_KEYFRAMES_INITIAL_CAPACITY  256
+#define FLV_KEYFRAMES_NONE              ((size_t) -1)
+#define FLV_KEYFRAMES_SIGNATURE         "FLVK"
+#define FLV_KEYFRAMES_VERSION           1
+
+typedef struct flv_keyframes_s {
+    int64      *times;          // milliseconds, ascending
+    u_int64    *positions;      // file offsets of the keyframe tags
+    size_t      count;
+    size_t      capacity;
+    void       *block;          // storage of both arrays
+} flv_keyframes_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void        flv_keyframes_init(flv_keyframes_t * keyframes);
+void        flv_keyframes_free(flv_keyframes_t * keyframes);
+flv_code    flv_keyframes_add(flv_keyframes_t * keyframes, int64 time, u_int64 position);
+
+/* decoded keyframes.times (seconds) and filepositions, both needed */
+flv_code    flv_keyframes_from_meta(flv_keyframes_t * keyframes, const flv_meta_t * meta);
+/* video keyframes of a tag index */
+flv_code    flv_keyframes_from_index(flv_keyframes_t * keyframes, const flv_index_t * index);
+flv_code    flv_keyframes_load(flv_keyframes_t * keyframes, const char * file);
+flv_code    flv_keyframes_save(const flv_keyframes_t * keyframes, const char * file);
+
+/* index of the keyframe at or before time, FLV_KEYFRAMES_NONE before the first one */
+size_t      flv_keyframes_find(const flv_keyframes_t * keyframes, int64 time);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_KEYFRAMES_H__ */
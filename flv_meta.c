@@ -0,0 +1,146 @@
+#include "flv_meta.h"
+
+#include <string.h>
+#include <stddef.h>
+
+
+/*
+ * Perfect hash over the known keys: (length + first byte + 9 * last byte) & 15 sends each
+ * of them to its own slot. Unknown keys may land on a used slot, the stored name is
+ * compared before use. Fields are stored as doubles at the given offset.
+ */
+#define FLV_META_HASH(key, size) \
+    (((size) + (u_byte) (key)[0] + 9u * (u_byte) (key)[(size) - 1]) & 15u)
+
+typedef struct flv_meta_key_s {
+    const char *name;
+    u_short     size;
+    u_int       field;          // FLV_META_*, 0 for an empty slot
+    size_t      offset;
+} flv_meta_key_t;
+
+#define FLV_META_KEY(name, field, member)  { name, sizeof(name) - 1, field, offsetof(flv_meta_t, member) }
+
+static const flv_meta_key_t flv_meta_keys[16] = {
+    /*  0 */ { NULL, 0, 0, 0 },
+    /*  1 */ FLV_META_KEY("audiocodecid", FLV_META_AUDIOCODECID, audiocodecid),
+    /*  2 */ FLV_META_KEY("height",       FLV_META_HEIGHT,       height),
+    /*  3 */ { NULL, 0, 0, 0 },
+    /*  4 */ FLV_META_KEY("width",        FLV_META_WIDTH,        width),
+    /*  5 */ { NULL, 0, 0, 0 },
+    /*  6 */ FLV_META_KEY("videocodecid", FLV_META_VIDEOCODECID, videocodecid),
+    /*  7 */ { NULL, 0, 0, 0 },
+    /*  8 */ { NULL, 0, 0, 0 },
+    /*  9 */ { NULL, 0, 0, 0 },
+    /* 10 */ FLV_META_KEY("duration",     FLV_META_DURATION,     duration),
+    /* 11 */ FLV_META_KEY("filesize",     FLV_META_FILESIZE,     filesize),
+    /* 12 */ FLV_META_KEY("framerate",    FLV_META_FRAMERATE,    framerate),
+    /* 13 */ { NULL, 0, 0, 0 },
+    /* 14 */ { NULL, 0, 0, 0 },
+    /* 15 */ { "keyframes", 9, FLV_META_KEYFRAMES, 0 },
+};
+
+
+static const flv_meta_key_t *
+flv_meta_lookup(const byte * key, u_short size)
+{
+    const flv_meta_key_t * entry;
+
+    if (size == 0) {
+        return NULL;
+    }
+    entry = &flv_meta_keys[FLV_META_HASH(key, size)];
+    if (entry->size != size || memcmp(entry->name, key, size) != 0) {
+        return NULL;
+    }
+    return entry;
+}
+
+
+void
+flv_meta_init(flv_meta_t * meta, double * times, double * positions, u_int capacity)
+{
+    memset(meta, 0, sizeof(flv_meta_t));
+    meta->keyframe_times = times;
+    meta->keyframe_positions = positions;
+    meta->keyframe_capacity = capacity;
+}
+
+
+/* keyframes: times and filepositions strict arrays */
+static flv_code
+flv_meta_keyframes(flv_meta_t * meta, const amf_view_t * keyframes)
+{
+    amf_cursor_t cursor;
+    amf_view_t view;
+    double * out;
+    amf_code e;
+
+    if (amf_cursor_enter(&cursor, keyframes) != AMF_ERROR_OK) {
+        return FLV_ERROR_INVALID_METADATA;
+    }
+    while ((e = amf_cursor_next(&cursor, &view)) == AMF_ERROR_OK) {
+        if (view.type != AMF_TYPE_ARRAY) {
+            continue;
+        }
+        if (view.key_size == 5 && memcmp(view.key, "times", 5) == 0) {
+            out = meta->keyframe_times;
+        } else if (view.key_size == 13 && memcmp(view.key, "filepositions", 13) == 0) {
+            out = meta->keyframe_positions;
+        } else {
+            continue;
+        }
+        if (view.count > meta->keyframe_count) {
+            meta->keyframe_count = view.count;
+        }
+        if (out != NULL) {
+            amf_view_as_doubles(&view, out, meta->keyframe_capacity);
+        }
+    }
+    meta->fields |= FLV_META_KEYFRAMES;
+    return (e == AMF_ERROR_END_TAG) ? FLV_OK : FLV_ERROR_INVALID_METADATA;
+}
+
+
+flv_code
+flv_meta_decode(flv_meta_t * meta, const void * body, size_t size)
+{
+    const flv_meta_key_t * entry;
+    amf_cursor_t top, cursor;
+    amf_view_t view;
+    amf_code e;
+    flv_code r;
+
+    amf_cursor_init(&top, body, size);
+    if (amf_cursor_next(&top, &view) != AMF_ERROR_OK
+    ||  view.type != AMF_TYPE_STRING
+    ||  view.string.size != 10
+    ||  memcmp(view.string.bytes, "onMetaData", 10) != 0)
+    {
+        return FLV_ERROR_INVALID_METADATA_NAME;
+    }
+    if (amf_cursor_next(&top, &view) != AMF_ERROR_OK
+    ||  (view.type != AMF_TYPE_OBJECT && view.type != AMF_TYPE_ASSOCIATIVE_ARRAY)
+    ||  amf_cursor_enter(&cursor, &view) != AMF_ERROR_OK)
+    {
+        return FLV_ERROR_INVALID_METADATA;
+    }
+
+    while ((e = amf_cursor_next(&cursor, &view)) == AMF_ERROR_OK) {
+        entry = flv_meta_lookup(view.key, view.key_size);
+        if (entry == NULL) {
+            continue;
+        }
+        if (entry->field == FLV_META_KEYFRAMES) {
+            if (view.type == AMF_TYPE_OBJECT || view.type == AMF_TYPE_ASSOCIATIVE_ARRAY) {
+                if ((r = flv_meta_keyframes(meta, &view)) != FLV_OK) {
+                    return r;
+                }
+            }
+        } else if (view.type == AMF_TYPE_NUMBER) {
+            *(double*) ((byte*) meta + entry->offset) = view.number;
+            meta->fields |= entry->field;
+        }
+    }
+    return (e == AMF_ERROR_END_TAG) ? FLV_OK : FLV_ERROR_INVALID_METADATA;
+}
@@ -0,0 +1,65 @@
+#ifndef __FLV_META_H__
+#define __FLV_META_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "amf.h"
+#include "amf_cursor.h"
+
+
+
+
+/*
+ * onMetaData bound to a plain struct: the encoded tag body is walked once with a cursor,
+ * known keys are told apart with a perfect hash and stored in place, everything else is
+ * skipped. No AMF tree is built.
+ *
+ * The keyframe arrays are copied into caller storage, keyframe_count tells how many
+ * entries the tag holds even when the storage is shorter.
+ */
+
+#define FLV_META_DURATION       0x0001
+#define FLV_META_WIDTH          0x0002
+#define FLV_META_HEIGHT         0x0004
+#define FLV_META_FRAMERATE      0x0008
+#define FLV_META_VIDEOCODECID   0x0010
+#define FLV_META_AUDIOCODECID   0x0020
+#define FLV_META_FILESIZE       0x0040
+#define FLV_META_KEYFRAMES      0x0080
+
+typedef struct flv_meta_s {
+    double      duration;
+    double      width;
+    double      height;
+    double      framerate;
+    double      videocodecid;
+    double      audiocodecid;
+    double      filesize;
+    u_int       fields;                 // FLV_META_* of the keys found
+
+    /* keyframes.times and keyframes.filepositions, either may be NULL */
+    double     *keyframe_times;
+    double     *keyframe_positions;
+    u_int       keyframe_capacity;
+    u_int       keyframe_count;
+} flv_meta_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* keyframe storage is kept, everything else is cleared */
+void        flv_meta_init(flv_meta_t * meta, double * times, double * positions, u_int capacity);
+/* decode a script tag body, "onMetaData" followed by an object or associative array */
+flv_code    flv_meta_decode(flv_meta_t * meta, const void * body, size_t size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_META_H__ */
@@ -0,0 +1,784 @@
+#include "flv_mux.h"
+
+
+/* H.264 NAL unit types */
+#define H264_NAL_SLICE          1
+#define H264_NAL_IDR_SLICE      5
+#define H264_NAL_SEI            6
+#define H264_NAL_SPS            7
+#define H264_NAL_PPS            8
+#define H264_NAL_AUD            9
+
+#define FLV_MUX_AVC_HEADER_SIZE 5u      // frame type / codec, packet type, composition time
+#define FLV_MUX_AAC_HEADER_SIZE 2u      // sound flags, packet type
+#define FLV_MUX_AAC_FLAGS       ((u_byte) 0xAF) // AAC, 44 kHz, 16 bits, stereo: fixed for AAC
+
+static const u_int adts_sample_rates[16] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350, 0, 0, 0
+};
+
+
+/* a frame ready to be written as a tag body */
+typedef struct flv_mux_frame_s {
+    u_byte     *body;
+    size_t      size;
+    size_t      capacity;
+    u_int       timestamp;
+    u_byte      keyframe;
+    u_byte      ready;
+} flv_mux_frame_t;
+
+
+/* Annex B H.264 reader */
+typedef struct flv_h264_source_s {
+    FILE           *in;
+    u_byte         *buffer;
+    size_t          size;           // valid bytes in buffer
+    size_t          pos;            // start of the current NAL payload
+    size_t          capacity;
+    u_byte          eof;
+    u_byte          started;        // first start code found
+
+    const u_byte   *pending;        // NAL starting the next access unit
+    size_t          pending_size;
+
+    u_byte         *sps;
+    u_short         sps_size;
+    u_byte         *pps;
+    u_short         pps_size;
+
+    u_int64         frames;
+    u_int           fps_num;
+    u_int           fps_den;
+} flv_h264_source_t;
+
+
+/* ADTS AAC reader */
+typedef struct flv_adts_source_s {
+    FILE           *in;
+    u_int           sample_rate;
+    u_byte          channels;
+    u_byte          config[2];      // AudioSpecificConfig
+    u_byte          has_config;
+    u_int64         frames;
+} flv_adts_source_t;
+
+
+typedef struct flv_mux_s {
+    FILE               *out;        // NULL for the sizing pass
+    u_byte             *buffer;
+    size_t              buffered;
+    u_int64             offset;     // bytes produced so far
+
+    /* keyframes recorded by the sizing pass */
+    double             *keyframe_times;
+    u_int64            *keyframe_positions;
+    size_t              keyframes;
+    size_t              keyframes_capacity;
+
+    u_int               last_video;
+    u_int               last_audio;
+} flv_mux_t;
+
+
+static flv_code
+flv_mux_reserve(u_byte ** buffer, size_t * capacity, size_t size)
+{
+    if (*capacity < size) {
+        size_t n = (*capacity > 0) ? *capacity : 4096;
+        u_byte * p;
+        while (n < size) {
+            n *= 2;
+        }
+        p = (u_byte *) realloc(*buffer, n);
+        if (p == NULL) {
+            std_log_error("alloc memory failed");
+            return FLV_ERROR_MEMORY;
+        }
+        *buffer = p;
+        *capacity = n;
+    }
+    return FLV_OK;
+}
+
+
+/* output, batched into FLV_MUX_BUFFER_SIZE writes */
+static flv_code
+flv_mux_flush(flv_mux_t * mux)
+{
+    if (mux->out != NULL && mux->buffered > 0) {
+        if (fwrite(mux->buffer, mux->buffered, 1, mux->out) == 0) {
+            std_log_error("write output failed");
+            return FLV_ERROR_OPEN_WRITE;
+        }
+    }
+    mux->buffered = 0;
+    return FLV_OK;
+}
+
+
+static flv_code
+flv_mux_write(flv_mux_t * mux, const void * data, size_t size)
+{
+    flv_code e;
+
+    mux->offset += size;
+    if (mux->out == NULL) {
+        return FLV_OK;
+    }
+
+    if (mux->buffered + size > FLV_MUX_BUFFER_SIZE) {
+        if ((e = flv_mux_flush(mux)) != FLV_OK) {
+            return e;
+        }
+        if (size >= FLV_MUX_BUFFER_SIZE) {
+            return (fwrite(data, size, 1, mux->out) == 1) ? FLV_OK : FLV_ERROR_OPEN_WRITE;
+        }
+    }
+    memcpy(mux->buffer + mux->buffered, data, size);
+    mux->buffered += size;
+    return FLV_OK;
+}
+
+
+static flv_code
+flv_mux_write_tag(flv_mux_t * mux, u_byte tag_type, u_int timestamp, const void * body, size_t size)
+{
+    flv_tag_header_t tag;
+    u_byte header[FLV_TAG_SIZE];
+    u_byte prev_tag_size[sizeof(u_int)];
+    flv_code e;
+
+    tag.tag_type = tag_type;
+    tag.body_length = (u_int) size;
+    tag.stream_ID = 0;
+    flv_tag_set_timestamp(&tag, timestamp);
+
+    flv_copy_tag(header, &tag, sizeof(header));
+    flv_copy_prev_tag_size(prev_tag_size, FLV_TAG_SIZE + (u_int) size, sizeof(prev_tag_size));
+
+    if ((e = flv_mux_write(mux, header, sizeof(header))) != FLV_OK
+    ||  (e = flv_mux_write(mux, body, size)) != FLV_OK
+    ||  (e = flv_mux_write(mux, prev_tag_size, sizeof(prev_tag_size))) != FLV_OK)
+    {
+        return e;
+    }
+    return FLV_OK;
+}
+
+
+static flv_code
+flv_mux_add_keyframe(flv_mux_t * mux, u_int timestamp)
+{
+    if (mux->keyframes == mux->keyframes_capacity) {
+        size_t n = (mux->keyframes_capacity > 0) ? mux->keyframes_capacity * 2 : 256;
+        double * times = (double *) realloc(mux->keyframe_times, n * sizeof(double));
+        u_int64 * positions;
+        if (times == NULL) {
+            return FLV_ERROR_MEMORY;
+        }
+        mux->keyframe_times = times;
+        positions = (u_int64 *) realloc(mux->keyframe_positions, n * sizeof(u_int64));
+        if (positions == NULL) {
+            return FLV_ERROR_MEMORY;
+        }
+        mux->keyframe_positions = positions;
+        mux->keyframes_capacity = n;
+    }
+
+    mux->keyframe_times[mux->keyframes] = timestamp / 1000.0;
+    mux->keyframe_positions[mux->keyframes] = mux->offset;
+    ++(mux->keyframes);
+    return FLV_OK;
+}
+
+
+/* Annex B reader */
+static flv_code
+flv_h264_fill(flv_h264_source_t * src)
+{
+    size_t n;
+    flv_code e;
+
+    /* keep the current NAL, drop what was already consumed */
+    if (src->pos > 0) {
+        memmove(src->buffer, src->buffer + src->pos, src->size - src->pos);
+        src->size -= src->pos;
+        src->pos = 0;
+    }
+    if ((e = flv_mux_reserve(&src->buffer, &src->capacity, src->size + FLV_MUX_READ_SIZE)) != FLV_OK) {
+        return e;
+    }
+
+    n = fread(src->buffer + src->size, sizeof(u_byte), FLV_MUX_READ_SIZE, src->in);
+    src->size += n;
+    if (n < FLV_MUX_READ_SIZE) {
+        src->eof = 1;
+    }
+    return FLV_OK;
+}
+
+
+/* next NAL unit, valid until the following call, *size is 0 at end of stream */
+static flv_code
+flv_h264_next_nal(flv_h264_source_t * src, const u_byte ** nal, size_t * size)
+{
+    size_t scan, end, next;
+    flv_code e;
+
+    *size = 0;
+
+    /* skip up to the first start code */
+    while (!src->started) {
+        for (scan = src->pos; scan + 3 <= src->size; ++scan) {
+            if (src->buffer[scan] == 0 && src->buffer[scan+1] == 0 && src->buffer[scan+2] == 1) {
+                src->pos = scan + 3;
+                src->started = 1;
+                break;
+            }
+        }
+        if (src->started) {
+            break;
+        }
+        if (src->eof) {
+            return FLV_OK;
+        }
+        src->pos = (src->size > 2) ? src->size - 2 : src->pos;
+        if ((e = flv_h264_fill(src)) != FLV_OK) {
+            return e;
+        }
+    }
+
+    for (;;) {
+        /* the NAL ends at the next start code */
+        scan = src->pos;
+        for (;;) {
+            for (; scan + 3 <= src->size; ++scan) {
+                if (src->buffer[scan] == 0 && src->buffer[scan+1] == 0 && src->buffer[scan+2] == 1) {
+                    break;
+                }
+            }
+            if (scan + 3 <= src->size) {
+                end = scan;
+                next = scan + 3;
+                break;
+            }
+            if (src->eof) {
+                end = next = src->size;
+                break;
+            }
+            scan -= src->pos;
+            if ((e = flv_h264_fill(src)) != FLV_OK) {
+                return e;
+            }
+            scan = (scan > 2) ? scan - 2 : 0;
+        }
+
+        /* trailing zeros belong to the next start code */
+        while (end > src->pos && src->buffer[end - 1] == 0) {
+            --end;
+        }
+
+        *nal = src->buffer + src->pos;
+        *size = end - src->pos;
+        src->pos = next;
+
+        /* empty NAL, go on with the next one unless the input is exhausted */
+        if (*size > 0 || (src->eof && src->pos >= src->size)) {
+            return FLV_OK;
+        }
+    }
+}
+
+
+static int
+flv_h264_starts_access_unit(const u_byte * nal, size_t size)
+{
+    switch (nal[0] & 0x1F) {
+        case H264_NAL_SEI:
+        case H264_NAL_SPS:
+        case H264_NAL_PPS:
+        case H264_NAL_AUD:
+            return 1;
+        case H264_NAL_SLICE:
+        case H264_NAL_IDR_SLICE:
+            /* first_mb_in_slice == 0, the ue(v) codes 0 as a single 1 bit */
+            return size > 1 && (nal[1] & 0x80);
+        default:
+            return 0;
+    }
+}
+
+
+static flv_code
+flv_h264_keep(u_byte ** to, u_short * to_size, const u_byte * nal, size_t size)
+{
+    if (*to == NULL && size <= 0xFFFF) {
+        *to = (u_byte *) malloc(size);
+        if (*to == NULL) {
+            return FLV_ERROR_MEMORY;
+        }
+        memcpy(*to, nal, size);
+        *to_size = (u_short) size;
+    }
+    return FLV_OK;
+}
+
+
+/* append a NAL unit to the access unit being built, 4 bytes length prefixed */
+static flv_code
+flv_h264_add_nal(flv_h264_source_t * src, flv_mux_frame_t * frame, const u_byte * nal, size_t size, u_byte * vcl)
+{
+    u_byte type = nal[0] & 0x1F;
+    flv_code e;
+
+    switch (type) {
+        case H264_NAL_SPS:
+            return flv_h264_keep(&src->sps, &src->sps_size, nal, size);
+        case H264_NAL_PPS:
+            return flv_h264_keep(&src->pps, &src->pps_size, nal, size);
+        case H264_NAL_AUD:
+            return FLV_OK;
+        case H264_NAL_IDR_SLICE:
+            frame->keyframe = 1;
+            *vcl = 1;
+            break;
+        case H264_NAL_SLICE:
+            *vcl = 1;
+            break;
+        default:
+            break;
+    }
+
+    if ((e = flv_mux_reserve(&frame->body, &frame->capacity, frame->size + 4 + size)) != FLV_OK) {
+        return e;
+    }
+    store_u_int32_be(frame->body + frame->size, (u_int) size);
+    memcpy(frame->body + frame->size + 4, nal, size);
+    frame->size += 4 + size;
+    return FLV_OK;
+}
+
+
+static flv_code
+flv_h264_next_frame(flv_h264_source_t * src, flv_mux_frame_t * frame)
+{
+    const u_byte * nal;
+    size_t size;
+    u_byte vcl = 0;
+    flv_code e;
+
+    frame->ready = 0;
+    frame->keyframe = 0;
+    if ((e = flv_mux_reserve(&frame->body, &frame->capacity, FLV_MUX_AVC_HEADER_SIZE)) != FLV_OK) {
+        return e;
+    }
+    frame->size = FLV_MUX_AVC_HEADER_SIZE;
+
+    if (src->pending != NULL) {
+        e = flv_h264_add_nal(src, frame, src->pending, src->pending_size, &vcl);
+        src->pending = NULL;
+        if (e != FLV_OK) {
+            return e;
+        }
+    }
+
+    for (;;) {
+        if ((e = flv_h264_next_nal(src, &nal, &size)) != FLV_OK) {
+            return e;
+        }
+        if (size == 0) {
+            break;
+        }
+        if (vcl && flv_h264_starts_access_unit(nal, size)) {
+            src->pending = nal;
+            src->pending_size = size;
+            break;
+        }
+        if ((e = flv_h264_add_nal(src, frame, nal, size, &vcl)) != FLV_OK) {
+            return e;
+        }
+    }
+
+    if (!vcl) {
+        return FLV_OK;
+    }
+
+    frame->body[0] = (u_byte) (((frame->keyframe ? FLV_VIDEO_TAG_FRAME_TYPE_KEYFRAME : FLV_VIDEO_TAG_FRAME_TYPE_INTERFRAME) << 4)
+                   | FLV_VIDEO_TAG_CODEC_AVC);
+    frame->body[1] = FLV_AVC_PACKET_TYPE_NALU;
+    store_u_int24_be(frame->body + 2, 0);
+    frame->timestamp = (u_int) (src->frames * 1000 * src->fps_den / src->fps_num);
+    ++(src->frames);
+    frame->ready = 1;
+    return FLV_OK;
+}
+
+
+/* AVCDecoderConfigurationRecord */
+static flv_code
+flv_h264_sequence_header(const flv_h264_source_t * src, flv_mux_frame_t * frame)
+{
+    size_t size = FLV_MUX_AVC_HEADER_SIZE + 11 + src->sps_size + src->pps_size;
+    u_byte * out;
+    flv_code e;
+
+    if ((e = flv_mux_reserve(&frame->body, &frame->capacity, size)) != FLV_OK) {
+        return e;
+    }
+    out = frame->body;
+
+    out[0] = (FLV_VIDEO_TAG_FRAME_TYPE_KEYFRAME << 4) | FLV_VIDEO_TAG_CODEC_AVC;
+    out[1] = FLV_AVC_PACKET_TYPE_SEQUENCE_HEADER;
+    store_u_int24_be(out + 2, 0);
+    out += FLV_MUX_AVC_HEADER_SIZE;
+
+    out[0] = 1;                     // configurationVersion
+    out[1] = src->sps[1];           // AVCProfileIndication
+    out[2] = src->sps[2];           // profile_compatibility
+    out[3] = src->sps[3];           // AVCLevelIndication
+    out[4] = 0xFF;                  // lengthSizeMinusOne: 3
+    out[5] = 0xE1;                  // numOfSequenceParameterSets: 1
+    store_u_int16_be(out + 6, src->sps_size);
+    memcpy(out + 8, src->sps, src->sps_size);
+    out += 8 + src->sps_size;
+    out[0] = 1;                     // numOfPictureParameterSets
+    store_u_int16_be(out + 1, src->pps_size);
+    memcpy(out + 3, src->pps, src->pps_size);
+
+    frame->size = size;
+    frame->timestamp = 0;
+    return FLV_OK;
+}
+
+
+/* ADTS reader */
+static flv_code
+flv_adts_next_frame(flv_adts_source_t * src, flv_mux_frame_t * frame)
+{
+    u_byte header[9];
+    u_int frame_length, header_length, object_type, frequency_index, skipped;
+    size_t n;
+    flv_code e;
+
+    frame->ready = 0;
+    frame->keyframe = 0;
+
+    /* the end of the stream ends the track only between two frames */
+    if ((n = fread(header, 1, 7, src->in)) == 0) {
+        return FLV_OK;
+    }
+
+    /* resync on the next header that looks valid, a byte at a time */
+    for (skipped = 0; ; ++skipped) {
+        if (n < 7) {
+            std_log_error("truncated ADTS header");
+            return FLV_ERROR_EOF;
+        }
+        header_length = (header[1] & 0x01) ? 7 : 9;     // protection_absent
+        frame_length = ((u_int) (header[3] & 0x03) << 11) | ((u_int) header[4] << 3) | (header[5] >> 5);
+        frequency_index = (header[2] >> 2) & 0x0F;
+        if (header[0] == 0xFF && (header[1] & 0xF6) == 0xF0    // syncword, layer 0
+        &&  frame_length >= header_length && adts_sample_rates[frequency_index] != 0)
+        {
+            break;
+        }
+        memmove(header, header + 1, 6);
+        n = 6 + fread(header + 6, 1, 1, src->in);
+    }
+    if (skipped > 0) {
+        std_log_error("lost ADTS sync, %u bytes skipped", skipped);
+    }
+    if (header_length == 9 && fread(header + 7, 2, 1, src->in) == 0) {
+        std_log_error("truncated ADTS header");
+        return FLV_ERROR_EOF;
+    }
+
+    if (!src->has_config) {
+        object_type = (header[2] >> 6) + 1;
+        src->channels = (u_byte) (((header[2] & 0x01) << 2) | (header[3] >> 6));
+        src->sample_rate = adts_sample_rates[frequency_index];
+        src->config[0] = (u_byte) ((object_type << 3) | (frequency_index >> 1));
+        src->config[1] = (u_byte) (((frequency_index & 0x01) << 7) | (src->channels << 3));
+        src->has_config = 1;
+    }
+
+    frame->size = FLV_MUX_AAC_HEADER_SIZE + frame_length - header_length;
+    if ((e = flv_mux_reserve(&frame->body, &frame->capacity, frame->size)) != FLV_OK) {
+        return e;
+    }
+    frame->body[0] = FLV_MUX_AAC_FLAGS;
+    frame->body[1] = FLV_AAC_PACKET_TYPE_RAW;
+    if (frame->size > FLV_MUX_AAC_HEADER_SIZE
+    &&  fread(frame->body + FLV_MUX_AAC_HEADER_SIZE, frame->size - FLV_MUX_AAC_HEADER_SIZE, 1, src->in) == 0)
+    {
+        std_log_error("truncated ADTS frame");
+        return FLV_ERROR_EOF;
+    }
+
+    frame->timestamp = (u_int) (src->frames * 1024 * 1000 / src->sample_rate);
+    ++(src->frames);
+    frame->ready = 1;
+    return FLV_OK;
+}
+
+
+/* one pass over the inputs, sizing only when mux->out is NULL */
+static flv_code
+flv_mux_pass(flv_mux_t * mux, flv_h264_source_t * video, flv_adts_source_t * audio)
+{
+    flv_mux_frame_t vf, af, sh;
+    flv_mux_frame_t * frame;
+    u_byte tag_type;
+    flv_code e;
+
+    memset(&vf, 0, sizeof(vf));
+    memset(&af, 0, sizeof(af));
+    memset(&sh, 0, sizeof(sh));
+
+    /* the first frames bring SPS / PPS and the AudioSpecificConfig */
+    if (video->in != NULL && (e = flv_h264_next_frame(video, &vf)) != FLV_OK) {
+        goto done;
+    }
+    if (audio->in != NULL && (e = flv_adts_next_frame(audio, &af)) != FLV_OK) {
+        goto done;
+    }
+
+    e = FLV_OK;
+    if (vf.ready && video->sps != NULL && video->pps != NULL && video->sps_size >= 4) {
+        if ((e = flv_h264_sequence_header(video, &sh)) != FLV_OK
+        ||  (e = flv_mux_write_tag(mux, FLV_TAG_HEADER_TYPE_VIDEO, 0, sh.body, sh.size)) != FLV_OK)
+        {
+            goto done;
+        }
+    }
+    if (af.ready) {
+        u_byte body[FLV_MUX_AAC_HEADER_SIZE + 2] = { FLV_MUX_AAC_FLAGS, FLV_AAC_PACKET_TYPE_SEQUENCE_HEADER };
+        body[2] = audio->config[0];
+        body[3] = audio->config[1];
+        if ((e = flv_mux_write_tag(mux, FLV_TAG_HEADER_TYPE_AUDIO, 0, body, sizeof(body))) != FLV_OK) {
+            goto done;
+        }
+    }
+
+    /* interleave by timestamp, video first on ties */
+    while (vf.ready || af.ready) {
+        if (vf.ready && (!af.ready || vf.timestamp <= af.timestamp)) {
+            frame = &vf;
+            tag_type = FLV_TAG_HEADER_TYPE_VIDEO;
+            mux->last_video = vf.timestamp;
+            if (vf.keyframe && mux->out == NULL && (e = flv_mux_add_keyframe(mux, vf.timestamp)) != FLV_OK) {
+                goto done;
+            }
+        } else {
+            frame = &af;
+            tag_type = FLV_TAG_HEADER_TYPE_AUDIO;
+            mux->last_audio = af.timestamp;
+        }
+
+        if ((e = flv_mux_write_tag(mux, tag_type, frame->timestamp, frame->body, frame->size)) != FLV_OK) {
+            goto done;
+        }
+
+        e = (frame == &vf) ? flv_h264_next_frame(video, &vf) : flv_adts_next_frame(audio, &af);
+        if (e != FLV_OK) {
+            goto done;
+        }
+    }
+
+    e = flv_mux_flush(mux);
+
+done:
+    free(vf.body);
+    free(af.body);
+    free(sh.body);
+    return e;
+}
+
+
+static void
+flv_mux_sources_reset(flv_h264_source_t * video, flv_adts_source_t * audio)
+{
+    if (video->in != NULL) {
+        rewind(video->in);
+    }
+    video->size = video->pos = 0;
+    video->eof = video->started = 0;
+    video->pending = NULL;
+    video->frames = 0;
+
+    if (audio->in != NULL) {
+        rewind(audio->in);
+    }
+    audio->frames = 0;
+}
+
+
+/* onMetaData, keyframes.filepositions are relative to the end of the metadata tag until shifted */
+static amf_data_t *
+flv_mux_metadata(const flv_mux_t * mux, const flv_h264_source_t * video, const flv_adts_source_t * audio)
+{
+    amf_data_t *data, *keyframes, *times, *positions;
+    double duration, audio_duration = 0;
+    size_t i;
+
+    data = amf_associative_array_new();
+    keyframes = amf_object_new();
+    times = amf_array_new();
+    positions = amf_array_new();
+    if (data == NULL || keyframes == NULL || times == NULL || positions == NULL) {
+        amf_data_free(data);
+        amf_data_free(keyframes);
+        amf_data_free(times);
+        amf_data_free(positions);
+        return NULL;
+    }
+
+    duration = (video->frames > 0) ? (double) video->frames * video->fps_den / video->fps_num : 0;
+    if (audio->frames > 0) {
+        audio_duration = (double) audio->frames * 1024 / audio->sample_rate;
+    }
+    if (audio_duration > duration) {
+        duration = audio_duration;
+    }
+
+    amf_associative_array_add(data, "duration",         amf_number_new_double(duration));
+    amf_associative_array_add(data, "filesize",         amf_number_new_double(0));
+    amf_associative_array_add(data, "hasVideo",         amf_boolean_new(video->frames > 0));
+    amf_associative_array_add(data, "hasAudio",         amf_boolean_new(audio->frames > 0));
+    amf_associative_array_add(data, "hasKeyframes",     amf_boolean_new(mux->keyframes > 0));
+    amf_associative_array_add(data, "hasMetadata",      amf_boolean_new(1));
+    if (video->frames > 0) {
+        amf_associative_array_add(data, "videocodecid", amf_number_new_double(FLV_VIDEO_TAG_CODEC_AVC));
+        amf_associative_array_add(data, "framerate",    amf_number_new_double((double) video->fps_num / video->fps_den));
+    }
+    if (audio->frames > 0) {
+        amf_associative_array_add(data, "audiocodecid",     amf_number_new_double(FLV_AUDIO_TAG_SOUND_FORMAT_AAC));
+        amf_associative_array_add(data, "audiosamplerate",  amf_number_new_double(audio->sample_rate));
+        amf_associative_array_add(data, "audiosamplesize",  amf_number_new_double(16));
+        amf_associative_array_add(data, "stereo",           amf_boolean_new(audio->channels > 1));
+    }
+    amf_associative_array_add(data, "lasttimestamp",    amf_number_new_double((mux->last_video > mux->last_audio ? mux->last_video : mux->last_audio) / 1000.0));
+
+    for (i = 0; i < mux->keyframes; ++i) {
+        amf_array_push(times, amf_number_new_double(mux->keyframe_times[i]));
+        amf_array_push(positions, amf_number_new_double((double) mux->keyframe_positions[i]));
+    }
+    amf_object_add(keyframes, "times", times);
+    amf_object_add(keyframes, "filepositions", positions);
+    amf_associative_array_add(data, "keyframes", keyframes);
+
+    return data;
+}
+
+
+flv_code
+flv_mux_files(const char * h264_path, const char * aac_path, const char * out_path, u_int fps_num, u_int fps_den)
+{
+    flv_h264_source_t video;
+    flv_adts_source_t audio;
+    flv_mux_t mux;
+    flv_header_t header;
+    amf_data_t *name = NULL, *data = NULL;
+    amf_node_t * node;
+    u_byte buffer[FLV_HEADER_SIZE + sizeof(u_int)];
+    u_byte * body = NULL;
+    size_t body_size;
+    u_int64 metadata_size;
+    flv_code e = FLV_OK;
+
+    memset(&video, 0, sizeof(video));
+    memset(&audio, 0, sizeof(audio));
+    memset(&mux, 0, sizeof(mux));
+    video.fps_num = (fps_num > 0) ? fps_num : FLV_MUX_DEFAULT_FPS_NUM;
+    video.fps_den = (fps_den > 0) ? fps_den : FLV_MUX_DEFAULT_FPS_DEN;
+
+    if (h264_path != NULL && (video.in = fopen(h264_path, "rb")) == NULL) {
+        std_log_error("file open failed: %s", h264_path);
+        return FLV_ERROR_OPEN_READ;
+    }
+    if (aac_path != NULL && (audio.in = fopen(aac_path, "rb")) == NULL) {
+        std_log_error("file open failed: %s", aac_path);
+        e = FLV_ERROR_OPEN_READ;
+        goto done;
+    }
+
+    header.version = FLV_VERSION;
+    header.flags = (video.in != NULL ? FLV_FLAG_VIDEO : 0) | (audio.in != NULL ? FLV_FLAG_AUDIO : 0);
+    header.offset = FLV_HEADER_SIZE;
+    flv_copy_header(buffer, &header, sizeof(buffer));
+    flv_copy_prev_tag_size(buffer + FLV_HEADER_SIZE, 0, sizeof(u_int));
+
+    /* sizing pass */
+    mux.offset = sizeof(buffer);
+    if ((e = flv_mux_pass(&mux, &video, &audio)) != FLV_OK) {
+        goto done;
+    }
+
+    /* metadata: sizes don't depend on the values, so positions can be shifted afterwards */
+    name = amf_str("onMetaData");
+    data = flv_mux_metadata(&mux, &video, &audio);
+    if (name == NULL || data == NULL) {
+        e = FLV_ERROR_MEMORY;
+        goto done;
+    }
+    body_size = amf_data_size(name) + amf_data_size(data);
+    metadata_size = FLV_TAG_SIZE + body_size + sizeof(u_int);
+
+    amf_number_set_double(amf_associative_array_get(data, "filesize"), (double) (mux.offset + metadata_size));
+    node = amf_array_first(amf_object_get(amf_associative_array_get(data, "keyframes"), "filepositions"));
+    for (; node != NULL; node = amf_array_next(node)) {
+        amf_number_set_double(amf_array_get(node), amf_number_get_double(amf_array_get(node)) + (double) metadata_size);
+    }
+
+    body = (u_byte *) malloc(body_size);
+    if (body == NULL) {
+        e = FLV_ERROR_MEMORY;
+        goto done;
+    }
+    amf_data_buffer_write(name, (byte *) body, body_size);
+    amf_data_buffer_write(data, (byte *) body + amf_data_size(name), body_size - amf_data_size(name));
+
+    /* writing pass */
+    mux.out = fopen(out_path, "wb");
+    if (mux.out == NULL) {
+        std_log_error("file open failed: %s", out_path);
+        e = FLV_ERROR_OPEN_WRITE;
+        goto done;
+    }
+    mux.buffer = (u_byte *) malloc(FLV_MUX_BUFFER_SIZE);
+    if (mux.buffer == NULL) {
+        e = FLV_ERROR_MEMORY;
+        goto done;
+    }
+    mux.offset = 0;
+    flv_mux_sources_reset(&video, &audio);
+
+    if ((e = flv_mux_write(&mux, buffer, sizeof(buffer))) != FLV_OK
+    ||  (e = flv_mux_write_tag(&mux, FLV_TAG_HEADER_TYPE_META, 0, body, body_size)) != FLV_OK
+    ||  (e = flv_mux_pass(&mux, &video, &audio)) != FLV_OK)
+    {
+        goto done;
+    }
+
+done:
+    if (mux.out != NULL && fclose(mux.out) != 0 && e == FLV_OK) {
+        e = FLV_ERROR_OPEN_WRITE;
+    }
+    if (video.in != NULL) {
+        fclose(video.in);
+    }
+    if (audio.in != NULL) {
+        fclose(audio.in);
+    }
+    amf_data_free(name);
+    amf_data_free(data);
+    free(body);
+    free(mux.buffer);
+    free(mux.keyframe_times);
+    free(mux.keyframe_positions);
+    free(video.buffer);
+    free(video.sps);
+    free(video.pps);
+    return e;
+}
@@ -0,0 +1,48 @@
+#ifndef __FLV_MUX_H__
+#define __FLV_MUX_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "amf.h"
+#include "flv.h"
+
+
+
+
+/*
+ * FLV muxer from elementary streams: Annex B H.264 and ADTS AAC.
+ *
+ * The AVCDecoderConfigurationRecord is built from the first SPS / PPS, the
+ * AudioSpecificConfig from the first ADTS header. Video timestamps follow the given
+ * frame rate (decode order, composition time offset is 0), audio timestamps follow
+ * the 1024 samples per AAC frame. Tags are interleaved by timestamp.
+ *
+ * The inputs are read twice: a first pass sizes every tag so that onMetaData can carry
+ * exact keyframes.filepositions and filesize, the second pass writes through an output
+ * buffer of FLV_MUX_BUFFER_SIZE bytes.
+ */
+
+#define FLV_MUX_BUFFER_SIZE         (1024u * 1024)
+#define FLV_MUX_READ_SIZE           (256u * 1024)
+
+#define FLV_MUX_DEFAULT_FPS_NUM     25
+#define FLV_MUX_DEFAULT_FPS_DEN     1
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* either input may be NULL, fps_num / fps_den give the video frame rate */
+flv_code    flv_mux_files(const char * h264_path, const char * aac_path, const char * out_path,
+                          u_int fps_num, u_int fps_den);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_MUX_H__ */
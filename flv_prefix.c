@@ -0,0 +1,146 @@
+#include "flv_prefix.h"
+
+#include <string.h>
+
+
+/* one block per track: bytes, offsets, then timestamps */
+static flv_code
+flv_prefix_track_alloc(flv_prefix_track_t * track, size_t count)
+{
+    u_int64 * block = (u_int64*) malloc((2 * count + 1) * sizeof(u_int64) + count * sizeof(u_int));
+    if (block == NULL) {
+        std_log_error("alloc memory failed");
+        return FLV_ERROR_MEMORY;
+    }
+    track->bytes = block;
+    track->offsets = block + count + 1;
+    track->timestamps = (u_int*) (block + 2 * count + 1);
+    track->bytes[0] = 0;
+    track->end = 0;
+    track->count = 0;
+    return FLV_OK;
+}
+
+
+static void
+flv_prefix_track_add(flv_prefix_track_t * track, const flv_tag_info_t * info)
+{
+    size_t i = track->count++;
+    u_int timestamp = info->timestamp;
+
+    if (i > 0 && timestamp < track->timestamps[i - 1]) {
+        timestamp = track->timestamps[i - 1];
+    }
+    track->timestamps[i] = timestamp;
+    track->offsets[i] = info->offset;
+    track->bytes[i + 1] = track->bytes[i] + info->body_length;
+    track->end = info->offset + FLV_TAG_SIZE + info->body_length + sizeof(u_int);
+}
+
+
+flv_code
+flv_prefix_build(flv_prefix_t * prefix, const flv_index_t * index)
+{
+    const flv_tag_info_t * info;
+    size_t i, audio = 0, video = 0;
+
+    memset(prefix, 0, sizeof(flv_prefix_t));
+    for (i = 0; i < flv_index_size(index); ++i) {
+        info = flv_index_get(index, i);
+        audio += (info->tag_type == FLV_TAG_HEADER_TYPE_AUDIO);
+        video += (info->tag_type == FLV_TAG_HEADER_TYPE_VIDEO);
+    }
+
+    if (flv_prefix_track_alloc(&prefix->audio, audio) != FLV_OK
+    ||  flv_prefix_track_alloc(&prefix->video, video) != FLV_OK
+    ||  flv_prefix_track_alloc(&prefix->all, flv_index_size(index)) != FLV_OK)
+    {
+        flv_prefix_free(prefix);
+        return FLV_ERROR_MEMORY;
+    }
+
+    for (i = 0; i < flv_index_size(index); ++i) {
+        info = flv_index_get(index, i);
+        if (info->tag_type == FLV_TAG_HEADER_TYPE_AUDIO) {
+            flv_prefix_track_add(&prefix->audio, info);
+        } else if (info->tag_type == FLV_TAG_HEADER_TYPE_VIDEO) {
+            flv_prefix_track_add(&prefix->video, info);
+        }
+        flv_prefix_track_add(&prefix->all, info);
+    }
+    return FLV_OK;
+}
+
+
+void
+flv_prefix_free(flv_prefix_t * prefix)
+{
+    if (prefix != NULL) {
+        free(prefix->audio.bytes);
+        free(prefix->video.bytes);
+        free(prefix->all.bytes);
+        memset(prefix, 0, sizeof(flv_prefix_t));
+    }
+}
+
+
+size_t
+flv_prefix_lower(const flv_prefix_track_t * track, u_int timestamp)
+{
+    size_t low = 0, high = track->count, middle;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (track->timestamps[middle] < timestamp) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+
+u_int64
+flv_prefix_bytes(const flv_prefix_track_t * track, u_int t0, u_int t1)
+{
+    size_t first, last;
+
+    if (t1 <= t0) {
+        return 0;
+    }
+    first = flv_prefix_lower(track, t0);
+    last = flv_prefix_lower(track, t1);
+    return track->bytes[last] - track->bytes[first];
+}
+
+
+double
+flv_prefix_bitrate(const flv_prefix_track_t * track, u_int timestamp, u_int window)
+{
+    u_int t0 = (timestamp > window / 2) ? timestamp - window / 2 : 0;
+    u_int t1 = (t0 + window >= t0) ? t0 + window : 0xFFFFFFFFu;
+
+    if (window == 0) {
+        return 0;
+    }
+    return (double) flv_prefix_bytes(track, t0, t1) * 8.0 * 1000.0 / (double) window;
+}
+
+
+flv_code
+flv_prefix_range(const flv_prefix_track_t * track, u_int t0, u_int t1, u_int64 * start, u_int64 * end)
+{
+    size_t first, last;
+
+    first = flv_prefix_lower(track, t0);
+    last = (t1 > t0) ? flv_prefix_lower(track, t1) : first;
+    if (first == last) {
+        return FLV_ERROR_EOF;
+    }
+
+    /* the tags are contiguous in the file, up to the next tag of the track or the end */
+    *start = track->offsets[first];
+    *end = (last < track->count) ? track->offsets[last] : track->end;
+    return FLV_OK;
+}
@@ -0,0 +1,62 @@
+#ifndef __FLV_PREFIX_H__
+#define __FLV_PREFIX_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "flv.h"
+#include "flv_index.h"
+
+
+
+
+/*
+ * Prefix sums over a tag index, per track: the tags of a track in file order, their
+ * timestamps, offsets, and the running total of their body bytes. The tags of a time
+ * range [t0, t1) are found with two binary searches, their byte count is a difference
+ * of two totals; nothing is rescanned.
+ *
+ * Timestamps are made non decreasing (a tag earlier than the one before it counts at
+ * that one's time), so that the searches hold on files with small reorders. The all
+ * track holds every tag, script tags included: its ranges are the bytes to fetch.
+ */
+
+typedef struct flv_prefix_track_s {
+    u_int      *timestamps;
+    u_int64    *offsets;        // file offsets of the tag headers
+    u_int64    *bytes;          // body bytes of the tags before i, count + 1 entries
+    u_int64     end;            // file offset after the last tag and its previous tag size
+    size_t      count;
+} flv_prefix_track_t;
+
+typedef struct flv_prefix_s {
+    flv_prefix_track_t  audio;
+    flv_prefix_track_t  video;
+    flv_prefix_track_t  all;
+} flv_prefix_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+flv_code    flv_prefix_build(flv_prefix_t * prefix, const flv_index_t * index);
+void        flv_prefix_free(flv_prefix_t * prefix);
+
+/* first tag at or after timestamp, count if none */
+size_t      flv_prefix_lower(const flv_prefix_track_t * track, u_int timestamp);
+/* body bytes of the tags in [t0, t1) */
+u_int64     flv_prefix_bytes(const flv_prefix_track_t * track, u_int t0, u_int t1);
+/* bits per second over the window (ms) centered on timestamp, 0 for an empty window */
+double      flv_prefix_bitrate(const flv_prefix_track_t * track, u_int timestamp, u_int window);
+/* file bytes [*start, *end) holding the tags in [t0, t1), FLV_ERROR_EOF when there are none */
+flv_code    flv_prefix_range(const flv_prefix_track_t * track, u_int t0, u_int t1, u_int64 * start, u_int64 * end);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_PREFIX_H__ */
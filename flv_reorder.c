@@ -0,0 +1,355 @@
+#include "flv_reorder.h"
+
+
+void
+flv_reorder_init(flv_reorder_t * reorder, flv_tag_proc sink, void * user_data)
+{
+    memset(reorder, 0, sizeof(flv_reorder_t));
+    reorder->window = FLV_REORDER_DEFAULT_WINDOW;
+    reorder->max_bytes = FLV_REORDER_DEFAULT_MAX_BYTES;
+    reorder->overflow = FLV_REORDER_OVERFLOW_FLUSH;
+    reorder->sink = sink;
+    reorder->user_data = user_data;
+}
+
+
+/* min-heap helpers */
+#define flv_reorder_less(a, b) \
+    ((a)->timestamp < (b)->timestamp || ((a)->timestamp == (b)->timestamp && (a)->sequence < (b)->sequence))
+
+static void
+flv_reorder_sift_up(flv_reorder_entry_t ** heap, size_t i)
+{
+    flv_reorder_entry_t * entry = heap[i];
+    while (i > 0 && flv_reorder_less(entry, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = entry;
+}
+
+
+static void
+flv_reorder_sift_down(flv_reorder_entry_t ** heap, size_t count, size_t i)
+{
+    flv_reorder_entry_t * entry = heap[i];
+    size_t child;
+    while ((child = 2 * i + 1) < count) {
+        if (child + 1 < count && flv_reorder_less(heap[child + 1], heap[child])) {
+            ++child;
+        }
+        if (!flv_reorder_less(heap[child], entry)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = entry;
+}
+
+
+static flv_code
+flv_reorder_grow(flv_reorder_entry_t *** array, size_t * capacity)
+{
+    size_t n = (*capacity > 0) ? *capacity * 2 : 64;
+    flv_reorder_entry_t ** a = (flv_reorder_entry_t **) realloc(*array, n * sizeof(flv_reorder_entry_t *));
+    if (a == NULL) {
+        std_log_error("alloc memory failed");
+        return FLV_ERROR_MEMORY;
+    }
+    *array = a;
+    *capacity = n;
+    return FLV_OK;
+}
+
+
+static void
+flv_reorder_entry_free(flv_reorder_t * reorder, flv_reorder_entry_t * entry)
+{
+    reorder->bytes -= entry->capacity;
+    free(entry->body);
+    free(entry);
+}
+
+
+/* give an entry back to the pool, or free it when the pool can't hold it */
+static void
+flv_reorder_release(flv_reorder_t * reorder, flv_reorder_entry_t * entry)
+{
+    if (reorder->pool_count == reorder->pool_capacity
+    &&  flv_reorder_grow(&reorder->pool, &reorder->pool_capacity) != FLV_OK)
+    {
+        flv_reorder_entry_free(reorder, entry);
+        return;
+    }
+    reorder->pool[reorder->pool_count++] = entry;
+}
+
+
+static flv_code
+flv_reorder_emit(flv_reorder_t * reorder)
+{
+    flv_reorder_entry_t * entry = reorder->heap[0];
+    int e = FLV_OK;
+
+    reorder->heap[0] = reorder->heap[--(reorder->count)];
+    if (reorder->count > 0) {
+        flv_reorder_sift_down(reorder->heap, reorder->count, 0);
+    }
+
+    if (reorder->emitted && entry->timestamp < reorder->last_emitted) {
+        ++(reorder->late);
+    }
+    reorder->emitted = 1;
+    reorder->last_emitted = entry->timestamp;
+
+    if (reorder->sink != NULL) {
+        e = reorder->sink(&entry->tag, entry->body, reorder->user_data);
+    }
+    flv_reorder_release(reorder, entry);
+    return (flv_code) e;
+}
+
+
+/* trim pooled buffers until `needed` more bytes fit under max_bytes */
+static int
+flv_reorder_fits(flv_reorder_t * reorder, size_t needed)
+{
+    while (reorder->bytes + needed > reorder->max_bytes && reorder->pool_count > 0) {
+        flv_reorder_entry_free(reorder, reorder->pool[--(reorder->pool_count)]);
+    }
+    return reorder->bytes + needed <= reorder->max_bytes;
+}
+
+
+/* take an entry able to hold body_length bytes, NULL on overflow */
+static flv_reorder_entry_t *
+flv_reorder_acquire(flv_reorder_t * reorder, u_int body_length)
+{
+    flv_reorder_entry_t * entry = NULL;
+    u_byte * body;
+    size_t i;
+
+    /* best candidate: a pooled buffer already large enough */
+    for (i = reorder->pool_count; i > 0; --i) {
+        if (reorder->pool[i - 1]->capacity >= body_length) {
+            entry = reorder->pool[i - 1];
+            reorder->pool[i - 1] = reorder->pool[--(reorder->pool_count)];
+            return entry;
+        }
+    }
+
+    if (reorder->pool_count > 0) {
+        entry = reorder->pool[--(reorder->pool_count)];
+        reorder->bytes -= entry->capacity;
+    } else {
+        entry = (flv_reorder_entry_t *) std_calloc(sizeof(flv_reorder_entry_t));
+        if (entry == NULL) {
+            return NULL;
+        }
+    }
+
+    if (!flv_reorder_fits(reorder, body_length)) {
+        free(entry->body);
+        free(entry);
+        return NULL;
+    }
+
+    body = (u_byte *) realloc(entry->body, (body_length > 0) ? body_length : 1);
+    if (body == NULL) {
+        free(entry->body);
+        free(entry);
+        return NULL;
+    }
+    entry->body = body;
+    entry->capacity = body_length;
+    reorder->bytes += body_length;
+    return entry;
+}
+
+
+/* apply the overflow policy until an entry can be acquired */
+static flv_code
+flv_reorder_acquire_or_overflow(flv_reorder_t * reorder, const flv_tag_header_t * tag, flv_reorder_entry_t ** out)
+{
+    flv_code e;
+
+    while ((*out = flv_reorder_acquire(reorder, tag->body_length)) == NULL) {
+        switch (reorder->overflow) {
+            case FLV_REORDER_OVERFLOW_DROP:
+                ++(reorder->dropped);
+                return FLV_OK;
+            case FLV_REORDER_OVERFLOW_ERROR:
+                std_log_error("reorder buffer overflow");
+                return FLV_ERROR_MEMORY;
+            default:
+                if (reorder->count == 0) {
+                    return FLV_OK;   /* larger than the cap on its own: pass through */
+                }
+                ++(reorder->forced);
+                if ((e = flv_reorder_emit(reorder)) != FLV_OK) {
+                    return e;
+                }
+        }
+    }
+    return FLV_OK;
+}
+
+
+/* queue an acquired entry and release what went out of the window */
+static flv_code
+flv_reorder_insert(flv_reorder_t * reorder, flv_reorder_entry_t * entry, const flv_tag_header_t * tag)
+{
+    flv_code e;
+
+    if (reorder->count == reorder->heap_capacity
+    &&  (e = flv_reorder_grow(&reorder->heap, &reorder->heap_capacity)) != FLV_OK)
+    {
+        flv_reorder_release(reorder, entry);
+        return e;
+    }
+
+    memcpy(&entry->tag, tag, sizeof(flv_tag_header_t));
+    entry->timestamp = flv_tag_get_timestamp(tag);
+    entry->sequence = reorder->sequence++;
+    reorder->heap[reorder->count] = entry;
+    flv_reorder_sift_up(reorder->heap, reorder->count++);
+
+    if (entry->timestamp > reorder->max_timestamp) {
+        reorder->max_timestamp = entry->timestamp;
+    }
+
+    while (reorder->count > 0 && (u_int64) reorder->heap[0]->timestamp + reorder->window <= reorder->max_timestamp) {
+        if ((e = flv_reorder_emit(reorder)) != FLV_OK) {
+            return e;
+        }
+    }
+    return FLV_OK;
+}
+
+
+flv_code
+flv_reorder_push(flv_reorder_t * reorder, const flv_tag_header_t * tag, const void * body)
+{
+    flv_reorder_entry_t * entry;
+    flv_code e;
+
+    /* a missing body would hand the sink the bytes of an earlier tag */
+    if (reorder == NULL || tag == NULL || (body == NULL && tag->body_length > 0)) {
+        return FLV_ERROR_NULL_POINTER;
+    }
+
+    if ((e = flv_reorder_acquire_or_overflow(reorder, tag, &entry)) != FLV_OK) {
+        return e;
+    }
+    if (entry == NULL) {
+        if (reorder->overflow == FLV_REORDER_OVERFLOW_FLUSH && reorder->sink != NULL) {
+            return (flv_code) reorder->sink((flv_tag_header_t *) tag, body, reorder->user_data);
+        }
+        return FLV_OK;
+    }
+
+    if (tag->body_length > 0) {
+        memcpy(entry->body, body, tag->body_length);
+    }
+    return flv_reorder_insert(reorder, entry, tag);
+}
+
+
+/* push the current tag of a stream, its body is read straight into the pooled buffer */
+flv_code
+flv_reorder_push_stream(flv_reorder_t * reorder, const flv_tag_header_t * tag, flv_stream_t * stream)
+{
+    flv_reorder_entry_t * entry;
+    u_byte * body;
+    flv_code e;
+
+    if (reorder == NULL || tag == NULL || stream == NULL) {
+        return FLV_ERROR_NULL_POINTER;
+    }
+
+    if ((e = flv_reorder_acquire_or_overflow(reorder, tag, &entry)) != FLV_OK) {
+        return e;
+    }
+    if (entry == NULL) {
+        if (reorder->overflow != FLV_REORDER_OVERFLOW_FLUSH || reorder->sink == NULL) {
+            return FLV_OK;
+        }
+        /* pass through with a transient buffer */
+        body = (u_byte *) malloc((tag->body_length > 0) ? tag->body_length : 1);
+        if (body == NULL) {
+            return FLV_ERROR_MEMORY;
+        }
+        if (flv_peek_tag_body(stream, body, tag->body_length) != tag->body_length) {
+            free(body);
+            return FLV_ERROR_EOF;
+        }
+        e = (flv_code) reorder->sink((flv_tag_header_t *) tag, body, reorder->user_data);
+        free(body);
+        return e;
+    }
+
+    if (tag->body_length > 0 && flv_peek_tag_body(stream, entry->body, tag->body_length) != tag->body_length) {
+        flv_reorder_release(reorder, entry);
+        return FLV_ERROR_EOF;
+    }
+    return flv_reorder_insert(reorder, entry, tag);
+}
+
+
+flv_code
+flv_reorder_flush(flv_reorder_t * reorder)
+{
+    flv_code e;
+
+    if (reorder == NULL) {
+        return FLV_ERROR_NULL_POINTER;
+    }
+
+    while (reorder->count > 0) {
+        if ((e = flv_reorder_emit(reorder)) != FLV_OK) {
+            return e;
+        }
+    }
+    return FLV_OK;
+}
+
+
+void
+flv_reorder_free(flv_reorder_t * reorder)
+{
+    if (reorder != NULL) {
+        while (reorder->count > 0) {
+            flv_reorder_entry_free(reorder, reorder->heap[--(reorder->count)]);
+        }
+        while (reorder->pool_count > 0) {
+            flv_reorder_entry_free(reorder, reorder->pool[--(reorder->pool_count)]);
+        }
+        free(reorder->heap);
+        free(reorder->pool);
+        reorder->heap = reorder->pool = NULL;
+        reorder->heap_capacity = reorder->pool_capacity = 0;
+    }
+}
+
+
+/* flv_parser_t callbacks */
+int
+flv_reorder_on_tag(flv_tag_header_t * tag, flv_parser_t * parser)
+{
+    return flv_reorder_push_stream((flv_reorder_t *) parser->user_data, tag, parser->stream);
+}
+
+
+int
+flv_reorder_on_stream_end(flv_parser_t * parser)
+{
+    return flv_reorder_flush((flv_reorder_t *) parser->user_data);
+}
+
+
+int
+flv_reorder_tag_proc(flv_tag_header_t * tag, const void * body, void * user_data)
+{
+    return flv_reorder_push((flv_reorder_t *) user_data, tag, body);
+}
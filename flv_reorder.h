@@ -0,0 +1,95 @@
+#ifndef __FLV_REORDER_H__
+#define __FLV_REORDER_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "flv.h"
+
+
+
+
+/*
+ * Bounded-interleave reordering buffer.
+ *
+ * Pending tags are kept in a min-heap ordered by timestamp (then input order) and a
+ * tag is released to the sink once a tag at least `window` ms newer has been pushed.
+ * Entries and their body buffers are pooled. The body buffers, pending and pooled,
+ * never exceed max_bytes: pooled buffers are trimmed first, then the overflow policy
+ * applies. The body handed to the sink is only valid during the call.
+ */
+
+#define FLV_REORDER_DEFAULT_WINDOW      3000u               // ms
+#define FLV_REORDER_DEFAULT_MAX_BYTES   (16u * 1024 * 1024)
+
+/* overflow policies */
+#define FLV_REORDER_OVERFLOW_FLUSH      0   // release the oldest pending tags early
+#define FLV_REORDER_OVERFLOW_DROP       1   // drop the incoming tag
+#define FLV_REORDER_OVERFLOW_ERROR      2   // fail with FLV_ERROR_MEMORY
+
+typedef struct flv_reorder_entry_s {
+    flv_tag_header_t    tag;
+    u_int               timestamp;      // full 32 bits timestamp
+    u_int64             sequence;       // input order, keeps equal timestamps stable
+    u_byte             *body;
+    u_int               capacity;
+} flv_reorder_entry_t;
+
+typedef struct flv_reorder_s {
+    /* configuration, may be changed after flv_reorder_init() */
+    u_int                   window;         // ms
+    size_t                  max_bytes;      // cap on body buffers, pending and pooled
+    u_byte                  overflow;       // one of FLV_REORDER_OVERFLOW_*
+
+    flv_tag_proc            sink;
+    void                   *user_data;
+
+    /* pending tags */
+    flv_reorder_entry_t   **heap;
+    size_t                  count;
+    size_t                  heap_capacity;
+
+    /* free entries, with their buffers */
+    flv_reorder_entry_t   **pool;
+    size_t                  pool_count;
+    size_t                  pool_capacity;
+
+    size_t                  bytes;          // allocated body buffers
+    u_int64                 sequence;
+    u_int                   max_timestamp;  // newest timestamp pushed
+
+    /* counters */
+    u_int64                 forced;         // tags released early by the overflow policy
+    u_int64                 dropped;
+    u_int64                 late;           // tags older than the last released one
+    u_byte                  emitted;
+    u_int                   last_emitted;
+} flv_reorder_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void        flv_reorder_init(flv_reorder_t * reorder, flv_tag_proc sink, void * user_data);
+/* body holds the body_length bytes of the tag, FLV_ERROR_NULL_POINTER if it is missing */
+flv_code    flv_reorder_push(flv_reorder_t * reorder, const flv_tag_header_t * tag, const void * body);
+flv_code    flv_reorder_push_stream(flv_reorder_t * reorder, const flv_tag_header_t * tag, flv_stream_t * stream);
+flv_code    flv_reorder_flush(flv_reorder_t * reorder);
+void        flv_reorder_free(flv_reorder_t * reorder);
+
+/* flv_parser_t callbacks, parser->user_data must point to the flv_reorder_t */
+int         flv_reorder_on_tag(flv_tag_header_t * tag, flv_parser_t * parser);
+int         flv_reorder_on_stream_end(flv_parser_t * parser);
+
+/* flv_tag_proc pushing into the flv_reorder_t given as user_data */
+int         flv_reorder_tag_proc(flv_tag_header_t * tag, const void * body, void * user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_REORDER_H__ */
@@ -0,0 +1,169 @@
+#include "flv_shift.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/* one worker per disjoint range of the tag index */
+typedef struct flv_shift_job_s {
+    int                     fd;
+    u_byte                 *map;    // NULL when writing through pwrite
+    const flv_tag_info_t   *tags;
+    size_t                  count;
+    int64                   delta_ms;
+    flv_code                error_code;
+} flv_shift_job_t;
+
+
+/* the shifted timestamp of a tag header, clamped to the 32 bits range */
+static void
+flv_shift_store(u_byte * header, u_int timestamp, int64 delta_ms)
+{
+    int64 ts = (int64) timestamp + delta_ms;
+    u_int shifted;
+
+    if (ts < 0) {
+        shifted = 0;
+    } else if (ts > 0xFFFFFFFF) {
+        shifted = 0xFFFFFFFF;
+    } else {
+        shifted = (u_int) ts;
+    }
+
+    /* 24 bits big-endian timestamp followed by timestamp_ex */
+    store_u_int24_be(header, shifted);
+    header[3] = (u_byte) (shifted >> 24);
+}
+
+
+static void *
+flv_shift_run(void * user_data)
+{
+    flv_shift_job_t * job = (flv_shift_job_t *) user_data;
+    u_byte timestamp[4];
+    size_t i;
+
+    for (i = 0; i < job->count; ++i) {
+        if (job->map != NULL) {
+            flv_shift_store(job->map + job->tags[i].offset + 4, job->tags[i].timestamp, job->delta_ms);
+            continue;
+        }
+
+        /* the 4 timestamp bytes only, in index order: the writes land in file order */
+        flv_shift_store(timestamp, job->tags[i].timestamp, job->delta_ms);
+        if (pwrite(job->fd, timestamp, sizeof(timestamp), (off_t) (job->tags[i].offset + 4)) != sizeof(timestamp)) {
+            job->error_code = FLV_ERROR_OPEN_WRITE;
+            return NULL;
+        }
+    }
+
+    job->error_code = FLV_OK;
+    return NULL;
+}
+
+
+/* shift the tags of an index, over a writable mapping if map is not NULL, through fd otherwise */
+flv_code
+flv_shift_index_timestamps(int fd, void * map, const flv_index_t * index, int64 delta_ms)
+{
+    flv_shift_job_t jobs[FLV_SHIFT_MAX_THREADS];
+    pthread_t threads[FLV_SHIFT_MAX_THREADS];
+    u_byte started[FLV_SHIFT_MAX_THREADS];
+    size_t per_thread, first = 0;
+    long cpus;
+    int n, i;
+    flv_code e = FLV_OK;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    n = (int) (index->count / FLV_SHIFT_MIN_TAGS_PER_THREAD);
+    if (n > cpus) {
+        n = (int) cpus;
+    }
+    if (n > FLV_SHIFT_MAX_THREADS) {
+        n = FLV_SHIFT_MAX_THREADS;
+    }
+    if (n < 1) {
+        n = 1;
+    }
+
+    per_thread = (index->count + n - 1) / n;
+    for (i = 0; i < n; ++i) {
+        jobs[i].fd = fd;
+        jobs[i].map = (u_byte *) map;
+        jobs[i].tags = index->tags + first;
+        jobs[i].count = (index->count - first < per_thread) ? index->count - first : per_thread;
+        jobs[i].delta_ms = delta_ms;
+        jobs[i].error_code = FLV_OK;
+        first += jobs[i].count;
+
+        /* the calling thread takes the last range, or all of them if a thread can't start */
+        started[i] = (i < n - 1 && pthread_create(&threads[i], NULL, flv_shift_run, &jobs[i]) == 0);
+        if (!started[i]) {
+            flv_shift_run(&jobs[i]);
+        }
+    }
+
+    for (i = 0; i < n; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        if (jobs[i].error_code != FLV_OK) {
+            e = jobs[i].error_code;
+        }
+    }
+    return e;
+}
+
+
+flv_code
+flv_shift_timestamps(const char * path, int64 delta_ms)
+{
+    flv_index_t index;
+    struct stat st;
+    void * map;
+    int fd;
+    flv_code e;
+
+    fd = open(path, O_RDWR);
+    if (fd < 0) {
+        std_log_error("file open failed: %s", path);
+        return FLV_ERROR_OPEN_WRITE;
+    }
+    if (fstat(fd, &st) != 0) {
+        std_log_error("file stat failed: %s", path);
+        close(fd);
+        return FLV_ERROR_OPEN;
+    }
+
+    map = MAP_FAILED;
+    if (st.st_size > 0 && (u_int64) st.st_size <= (size_t) -1) {
+        map = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    if (map != MAP_FAILED) {
+        e = flv_index_buffer(map, (size_t) st.st_size, &index);
+        if (e == FLV_OK) {
+            e = flv_shift_index_timestamps(fd, map, &index, delta_ms);
+        }
+        if (msync(map, (size_t) st.st_size, MS_SYNC) != 0 && e == FLV_OK) {
+            e = FLV_ERROR_OPEN_WRITE;
+        }
+        munmap(map, (size_t) st.st_size);
+    } else {
+        /* no mapping: header walk, then one pwrite per tag */
+        e = flv_index_file(path, &index);
+        if (e == FLV_OK) {
+            e = flv_shift_index_timestamps(fd, NULL, &index, delta_ms);
+        }
+    }
+
+    if (e != FLV_OK) {
+        std_log_error("shift timestamps failed: %s", path);
+    }
+    flv_index_free(&index);
+    close(fd);
+    return e;
+}
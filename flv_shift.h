@@ -0,0 +1,39 @@
+#ifndef __FLV_SHIFT_H__
+#define __FLV_SHIFT_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "flv.h"
+#include "flv_index.h"
+
+
+
+
+/*
+ * In-place timestamp shifting: only the 4 timestamp bytes of each tag header are
+ * rewritten, through a shared writable mapping or, when the file cannot be mapped,
+ * one 4 bytes pwrite per tag in index order. Tag bodies are never read nor copied.
+ * Shifted timestamps are clamped to 0 and 0xFFFFFFFF. Metadata contents (duration,
+ * keyframes.times) are left untouched.
+ */
+
+#define FLV_SHIFT_MAX_THREADS           8
+#define FLV_SHIFT_MIN_TAGS_PER_THREAD   65536
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+flv_code    flv_shift_timestamps(const char * path, int64 delta_ms);
+flv_code    flv_shift_index_timestamps(int fd, void * map, const flv_index_t * index, int64 delta_ms);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_SHIFT_H__ */
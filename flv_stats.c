@@ -0,0 +1,440 @@
+#include "flv_stats.h"
+
+
+static const double flv_stats_quantile_ps[FLV_STATS_QUANTILES] = { 0.50, 0.90, 0.99 };
+
+
+/* histogram functions */
+void
+flv_histogram_init(flv_histogram_t * histogram, u_int bucket_width)
+{
+    memset(histogram, 0, sizeof(flv_histogram_t));
+    histogram->bucket_width = (bucket_width > 0) ? bucket_width : 1;
+}
+
+
+void
+flv_histogram_add(flv_histogram_t * histogram, u_int64 value)
+{
+    u_int64 bucket = value / histogram->bucket_width;
+    if (bucket >= FLV_HISTOGRAM_BUCKETS) {
+        bucket = FLV_HISTOGRAM_BUCKETS - 1;
+    }
+    ++(histogram->buckets[bucket]);
+    ++(histogram->count);
+}
+
+
+/* upper bound of the bucket holding the p-th percentile */
+u_int64
+flv_histogram_percentile(const flv_histogram_t * histogram, double p)
+{
+    u_int64 rank, seen = 0;
+    u_int i;
+
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    rank = (u_int64) (p * (double) histogram->count);
+    for (i = 0; i < FLV_HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if (seen > rank) {
+            break;
+        }
+    }
+    if (i == FLV_HISTOGRAM_BUCKETS) {
+        i = FLV_HISTOGRAM_BUCKETS - 1;
+    }
+    return (u_int64) (i + 1) * histogram->bucket_width;
+}
+
+
+/* quantile functions, Jain & Chlamtac P-square algorithm */
+void
+flv_quantile_init(flv_quantile_t * quantile, double p)
+{
+    memset(quantile, 0, sizeof(flv_quantile_t));
+    quantile->p = p;
+}
+
+
+static double
+flv_quantile_parabolic(const flv_quantile_t * q, int i, double d)
+{
+    const double * h = q->heights;
+    const double * n = q->positions;
+    return h[i] + d / (n[i+1] - n[i-1])
+        * ((n[i] - n[i-1] + d) * (h[i+1] - h[i]) / (n[i+1] - n[i])
+        +  (n[i+1] - n[i] - d) * (h[i] - h[i-1]) / (n[i] - n[i-1]));
+}
+
+
+static double
+flv_quantile_linear(const flv_quantile_t * q, int i, int d)
+{
+    const double * h = q->heights;
+    const double * n = q->positions;
+    return h[i] + d * (h[i+d] - h[i]) / (n[i+d] - n[i]);
+}
+
+
+static void
+flv_quantile_sort(double * values, int count)
+{
+    int i, j;
+    double v;
+    for (i = 1; i < count; ++i) {
+        v = values[i];
+        for (j = i - 1; j >= 0 && values[j] > v; --j) {
+            values[j+1] = values[j];
+        }
+        values[j+1] = v;
+    }
+}
+
+
+void
+flv_quantile_add(flv_quantile_t * q, double value)
+{
+    const double p = q->p;
+    const double increments[5] = { 0, p / 2, p, (1 + p) / 2, 1 };
+    double d, h;
+    int i, k;
+
+    /* the first five samples seed the markers */
+    if (q->count < 5) {
+        q->heights[q->count++] = value;
+        if (q->count == 5) {
+            flv_quantile_sort(q->heights, 5);
+            for (i = 0; i < 5; ++i) {
+                q->positions[i] = i + 1;
+            }
+            q->desired[0] = 1;
+            q->desired[1] = 1 + 2 * p;
+            q->desired[2] = 1 + 4 * p;
+            q->desired[3] = 3 + 2 * p;
+            q->desired[4] = 5;
+        }
+        return;
+    }
+    ++(q->count);
+
+    /* find the cell holding the new sample */
+    if (value < q->heights[0]) {
+        q->heights[0] = value;
+        k = 0;
+    } else if (value >= q->heights[4]) {
+        q->heights[4] = value;
+        k = 3;
+    } else {
+        for (k = 0; k < 3 && value >= q->heights[k+1]; ++k) {
+        }
+    }
+
+    for (i = k + 1; i < 5; ++i) {
+        q->positions[i] += 1;
+    }
+    for (i = 0; i < 5; ++i) {
+        q->desired[i] += increments[i];
+    }
+
+    /* adjust the inner markers */
+    for (i = 1; i < 4; ++i) {
+        d = q->desired[i] - q->positions[i];
+        if ((d >=  1 && q->positions[i+1] - q->positions[i] >  1)
+        ||  (d <= -1 && q->positions[i-1] - q->positions[i] < -1))
+        {
+            d = (d >= 0) ? 1 : -1;
+            h = flv_quantile_parabolic(q, i, d);
+            if (q->heights[i-1] < h && h < q->heights[i+1]) {
+                q->heights[i] = h;
+            } else {
+                q->heights[i] = flv_quantile_linear(q, i, (int) d);
+            }
+            q->positions[i] += d;
+        }
+    }
+}
+
+
+double
+flv_quantile_get(const flv_quantile_t * q)
+{
+    double values[5];
+    int i;
+
+    if (q->count == 0) {
+        return 0;
+    }
+    if (q->count >= 5) {
+        return q->heights[2];
+    }
+
+    /* not enough samples for the markers, pick from the sorted seeds */
+    for (i = 0; i < (int) q->count; ++i) {
+        values[i] = q->heights[i];
+    }
+    flv_quantile_sort(values, (int) q->count);
+    i = (int) (q->p * (q->count - 1) + 0.5);
+    return values[i];
+}
+
+
+/* per stream accounting */
+static void
+flv_track_stats_init(flv_track_stats_t * track)
+{
+    int i;
+    memset(track, 0, sizeof(flv_track_stats_t));
+    flv_histogram_init(&track->bitrate_histogram, FLV_STATS_BITRATE_BUCKET);
+    for (i = 0; i < FLV_STATS_QUANTILES; ++i) {
+        flv_quantile_init(&track->bitrate_quantiles[i], flv_stats_quantile_ps[i]);
+    }
+}
+
+
+static void
+flv_track_stats_close_second(flv_track_stats_t * track)
+{
+    u_int64 kbps;
+    int i;
+
+    if (track->second_bytes == 0) {
+        return;
+    }
+
+    kbps = track->second_bytes * 8 / 1000;
+    flv_histogram_add(&track->bitrate_histogram, kbps);
+    for (i = 0; i < FLV_STATS_QUANTILES; ++i) {
+        flv_quantile_add(&track->bitrate_quantiles[i], (double) kbps);
+    }
+    if (track->second_bytes > track->max_second_bytes) {
+        track->max_second_bytes = track->second_bytes;
+    }
+    ++(track->seconds);
+    track->second_bytes = 0;
+}
+
+
+static void
+flv_track_stats_add(flv_track_stats_t * track, const flv_tag_info_t * info, u_int gap_threshold)
+{
+    u_int ts = info->timestamp;
+
+    if (!track->started) {
+        track->started = 1;
+        track->first_timestamp = ts;
+        track->second = ts / 1000;
+        track->burst_window = ts / FLV_STATS_BURST_WINDOW;
+    } else if (ts < track->last_timestamp) {
+        ++(track->regressions);
+        if (track->last_timestamp - ts > track->max_regression) {
+            track->max_regression = track->last_timestamp - ts;
+        }
+    } else if (ts - track->last_timestamp > gap_threshold) {
+        ++(track->gaps);
+        if (ts - track->last_timestamp > track->max_gap) {
+            track->max_gap = ts - track->last_timestamp;
+        }
+    }
+
+    /* regressions stay accounted to the current window */
+    if (ts / 1000 > track->second) {
+        flv_track_stats_close_second(track);
+        track->second = ts / 1000;
+    }
+    if (ts / FLV_STATS_BURST_WINDOW > track->burst_window) {
+        track->burst_window = ts / FLV_STATS_BURST_WINDOW;
+        track->burst_bytes = 0;
+    }
+
+    track->second_bytes += info->body_length;
+    track->burst_bytes += info->body_length;
+    if (track->burst_bytes > track->max_burst_bytes) {
+        track->max_burst_bytes = track->burst_bytes;
+    }
+
+    ++(track->tags);
+    track->bytes += info->body_length;
+    track->last_timestamp = ts;
+}
+
+
+/* GOP accounting */
+static void
+flv_stats_close_gop(flv_stats_t * stats)
+{
+    if (!stats->in_gop) {
+        return;
+    }
+
+    flv_histogram_add(&stats->gop_histogram, stats->gop_frames);
+    if (stats->keyframes == 1 || stats->gop_frames < stats->min_gop) {
+        stats->min_gop = stats->gop_frames;
+    }
+    if (stats->gop_frames > stats->max_gop) {
+        stats->max_gop = stats->gop_frames;
+    }
+}
+
+
+static void
+flv_stats_add_video_frame(flv_stats_t * stats, const flv_tag_info_t * info)
+{
+    u_int interval;
+    int i;
+
+    ++(stats->frames);
+
+    if (flv_tag_info_is_keyframe(info)) {
+        flv_stats_close_gop(stats);
+
+        if (stats->in_gop) {
+            interval = (info->timestamp >= stats->last_keyframe_timestamp)
+                ? info->timestamp - stats->last_keyframe_timestamp : 0;
+            flv_histogram_add(&stats->keyframe_interval_histogram, interval);
+            for (i = 0; i < FLV_STATS_QUANTILES; ++i) {
+                flv_quantile_add(&stats->keyframe_interval_quantiles[i], (double) interval);
+            }
+        }
+
+        ++(stats->keyframes);
+        stats->in_gop = 1;
+        stats->gop_frames = 0;
+        stats->last_keyframe_timestamp = info->timestamp;
+    }
+
+    /* frames before the first keyframe do not belong to any GOP */
+    if (stats->in_gop) {
+        ++(stats->gop_frames);
+    }
+}
+
+
+/* one pass analysis */
+void
+flv_stats_init(flv_stats_t * stats)
+{
+    int i;
+
+    memset(stats, 0, sizeof(flv_stats_t));
+    stats->gap_threshold = FLV_STATS_DEFAULT_GAP_THRESHOLD;
+
+    flv_track_stats_init(&stats->audio);
+    flv_track_stats_init(&stats->video);
+
+    flv_histogram_init(&stats->gop_histogram, FLV_STATS_GOP_BUCKET);
+    flv_histogram_init(&stats->keyframe_interval_histogram, FLV_STATS_KEYFRAME_INTERVAL_BUCKET);
+    for (i = 0; i < FLV_STATS_QUANTILES; ++i) {
+        flv_quantile_init(&stats->keyframe_interval_quantiles[i], flv_stats_quantile_ps[i]);
+    }
+}
+
+
+/* feed one tag, usable as a flv_walk_proc through flv_stats_file() */
+int
+flv_stats_add(flv_stats_t * stats, const flv_tag_info_t * info)
+{
+    switch (info->tag_type) {
+        case FLV_TAG_HEADER_TYPE_AUDIO:
+            flv_track_stats_add(&stats->audio, info, stats->gap_threshold);
+            break;
+        case FLV_TAG_HEADER_TYPE_VIDEO:
+            flv_track_stats_add(&stats->video, info, stats->gap_threshold);
+            if (flv_tag_info_is_video_frame(info)) {
+                flv_stats_add_video_frame(stats, info);
+            }
+            break;
+        case FLV_TAG_HEADER_TYPE_META:
+            ++(stats->script_tags);
+            break;
+        default:
+            ++(stats->unknown_tags);
+            break;
+    }
+    return FLV_OK;
+}
+
+
+/* flush the open second windows and the trailing GOP */
+void
+flv_stats_finish(flv_stats_t * stats)
+{
+    flv_track_stats_close_second(&stats->audio);
+    flv_track_stats_close_second(&stats->video);
+    flv_stats_close_gop(stats);
+    stats->in_gop = 0;
+}
+
+
+static int
+flv_stats_walk(const flv_tag_info_t * info, void * user_data)
+{
+    return flv_stats_add((flv_stats_t *) user_data, info);
+}
+
+
+flv_code
+flv_stats_file(const char * file, flv_stats_t * stats)
+{
+    flv_code e;
+
+    flv_stats_init(stats);
+    e = flv_walk(file, flv_stats_walk, stats);
+    flv_stats_finish(stats);
+    return e;
+}
+
+
+/* bucket counts, one bucket_width apart */
+static void
+flv_histogram_dump(FILE * out, const flv_histogram_t * histogram)
+{
+    u_int i;
+
+    fprintf(out, "[");
+    for (i = 0; i < FLV_HISTOGRAM_BUCKETS; ++i) {
+        fprintf(out, (i == 0) ? "%llu" : ", %llu", histogram->buckets[i]);
+    }
+    fprintf(out, "]");
+}
+
+
+static void
+flv_track_stats_dump(FILE * out, const char * name, const flv_track_stats_t * track)
+{
+    fprintf(out, "%s: { tags:%llu, bytes:%llu, first_timestamp:%u, last_timestamp:%u,\n",
+            name, track->tags, track->bytes, track->first_timestamp, track->last_timestamp);
+    fprintf(out, "    bitrate_kbps: { seconds:%llu, max:%llu, p50:%.0f, p90:%.0f, p99:%.0f },\n",
+            track->seconds, track->max_second_bytes * 8 / 1000,
+            flv_quantile_get(&track->bitrate_quantiles[0]),
+            flv_quantile_get(&track->bitrate_quantiles[1]),
+            flv_quantile_get(&track->bitrate_quantiles[2]));
+    fprintf(out, "    bitrate_histogram: ");
+    flv_histogram_dump(out, &track->bitrate_histogram);
+    fprintf(out, ",\n");
+    fprintf(out, "    max_burst_bytes:%llu, gaps:%llu, max_gap:%u, regressions:%llu, max_regression:%u }\n",
+            track->max_burst_bytes, track->gaps, track->max_gap, track->regressions, track->max_regression);
+}
+
+
+void
+flv_stats_dump(FILE * out, const flv_stats_t * stats)
+{
+    flv_track_stats_dump(out, "audio", &stats->audio);
+    flv_track_stats_dump(out, "video", &stats->video);
+
+    fprintf(out, "gop: { frames:%llu, keyframes:%llu, min:%u, max:%u,\n",
+            stats->frames, stats->keyframes, stats->min_gop, stats->max_gop);
+    fprintf(out, "    keyframe_interval_ms: { p50:%.0f, p90:%.0f, p99:%.0f },\n",
+            flv_quantile_get(&stats->keyframe_interval_quantiles[0]),
+            flv_quantile_get(&stats->keyframe_interval_quantiles[1]),
+            flv_quantile_get(&stats->keyframe_interval_quantiles[2]));
+    fprintf(out, "    keyframe_interval_histogram: ");
+    flv_histogram_dump(out, &stats->keyframe_interval_histogram);
+    fprintf(out, ",\n    length_histogram: ");
+    flv_histogram_dump(out, &stats->gop_histogram);
+    fprintf(out, " }\n");
+    fprintf(out, "script_tags:%llu, unknown_tags:%llu\n", stats->script_tags, stats->unknown_tags);
+}
@@ -0,0 +1,119 @@
+#ifndef __FLV_STATS_H__
+#define __FLV_STATS_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "flv.h"
+
+
+
+
+/* fixed-bucket histogram, the last bucket collects overflow */
+#define FLV_HISTOGRAM_BUCKETS   32
+
+typedef struct flv_histogram_s {
+    u_int       bucket_width;
+    u_int64     count;
+    u_int64     buckets[FLV_HISTOGRAM_BUCKETS];
+} flv_histogram_t;
+
+
+/* streaming quantile estimator (P-square), five markers whatever the sample count */
+typedef struct flv_quantile_s {
+    double      p;
+    u_int64     count;
+    double      heights[5];     // marker heights
+    double      positions[5];   // actual marker positions
+    double      desired[5];     // desired marker positions
+} flv_quantile_t;
+
+#define FLV_STATS_QUANTILES     3   // p50, p90, p99
+
+
+/* per stream (audio or video) accounting */
+typedef struct flv_track_stats_s {
+    u_int64             tags;
+    u_int64             bytes;                  // body bytes
+    u_int               first_timestamp;
+    u_int               last_timestamp;
+    u_byte              started;
+
+    /* per-second bitrate, only seconds carrying data are sampled */
+    u_int               second;                 // current second index (timestamp / 1000)
+    u_int64             second_bytes;
+    u_int64             seconds;
+    u_int64             max_second_bytes;
+    flv_histogram_t     bitrate_histogram;      // in kbit/s
+    flv_quantile_t      bitrate_quantiles[FLV_STATS_QUANTILES];
+
+    /* burst: bytes carried inside one FLV_STATS_BURST_WINDOW window */
+    u_int               burst_window;
+    u_int64             burst_bytes;
+    u_int64             max_burst_bytes;
+
+    /* timestamp continuity */
+    u_int64             gaps;                   // forward jumps above the gap threshold
+    u_int               max_gap;
+    u_int64             regressions;            // backward jumps
+    u_int               max_regression;
+} flv_track_stats_t;
+
+
+#define FLV_STATS_DEFAULT_GAP_THRESHOLD     1000u   // ms
+#define FLV_STATS_BURST_WINDOW              100u    // ms
+#define FLV_STATS_BITRATE_BUCKET            250u    // kbit/s
+#define FLV_STATS_GOP_BUCKET                10u     // frames
+#define FLV_STATS_KEYFRAME_INTERVAL_BUCKET  500u    // ms
+
+typedef struct flv_stats_s {
+    u_int               gap_threshold;          // ms, see FLV_STATS_DEFAULT_GAP_THRESHOLD
+
+    flv_track_stats_t   audio;
+    flv_track_stats_t   video;
+    u_int64             script_tags;
+    u_int64             unknown_tags;
+
+    /* GOP structure, from video keyframes */
+    u_int64             frames;
+    u_int64             keyframes;
+    u_byte              in_gop;
+    u_int               gop_frames;             // frames of the current GOP
+    u_int               last_keyframe_timestamp;
+    u_int               min_gop;
+    u_int               max_gop;
+    flv_histogram_t     gop_histogram;          // in frames
+    flv_histogram_t     keyframe_interval_histogram;    // in ms
+    flv_quantile_t      keyframe_interval_quantiles[FLV_STATS_QUANTILES];
+} flv_stats_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* histogram functions */
+void        flv_histogram_init(flv_histogram_t * histogram, u_int bucket_width);
+void        flv_histogram_add(flv_histogram_t * histogram, u_int64 value);
+u_int64     flv_histogram_percentile(const flv_histogram_t * histogram, double p);
+
+/* quantile functions */
+void        flv_quantile_init(flv_quantile_t * quantile, double p);
+void        flv_quantile_add(flv_quantile_t * quantile, double value);
+double      flv_quantile_get(const flv_quantile_t * quantile);
+
+/* one pass analysis */
+void        flv_stats_init(flv_stats_t * stats);
+int         flv_stats_add(flv_stats_t * stats, const flv_tag_info_t * info);
+void        flv_stats_finish(flv_stats_t * stats);
+flv_code    flv_stats_file(const char * file, flv_stats_t * stats);
+void        flv_stats_dump(FILE * out, const flv_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_STATS_H__ */
@@ -0,0 +1,232 @@
+#include "flv_ts_repair.h"
+
+
+void
+flv_ts_repair_init(flv_ts_repair_t * repair, flv_tag_proc sink, void * user_data)
+{
+    u_int i;
+
+    memset(repair, 0, sizeof(flv_ts_repair_t));
+    repair->max_gap = FLV_TS_REPAIR_DEFAULT_MAX_GAP;
+    repair->lookahead = FLV_TS_REPAIR_DEFAULT_LOOKAHEAD;
+    repair->sink = sink;
+    repair->user_data = user_data;
+
+    repair->tracks[FLV_TS_TRACK_AUDIO].duration = FLV_TS_REPAIR_DEFAULT_AUDIO_DURATION;
+    repair->tracks[FLV_TS_TRACK_VIDEO].duration = FLV_TS_REPAIR_DEFAULT_VIDEO_DURATION;
+
+    /* window[0, count) holds pending slots, window[count, MAX) the free ones */
+    for (i = 0; i < FLV_TS_REPAIR_MAX_LOOKAHEAD; ++i) {
+        repair->window[i] = &repair->slots[i];
+    }
+}
+
+
+static int
+flv_ts_repair_track(u_byte tag_type)
+{
+    switch (tag_type) {
+        case FLV_TAG_HEADER_TYPE_AUDIO: return FLV_TS_TRACK_AUDIO;
+        case FLV_TAG_HEADER_TYPE_VIDEO: return FLV_TS_TRACK_VIDEO;
+        default:                        return FLV_TS_TRACK_SCRIPT;
+    }
+}
+
+
+static int64
+flv_ts_repair_last_out(const flv_ts_repair_t * repair)
+{
+    int64 last = 0;
+    int i;
+    for (i = 0; i < FLV_TS_TRACKS; ++i) {
+        if (repair->tracks[i].started && repair->tracks[i].last_out > last) {
+            last = repair->tracks[i].last_out;
+        }
+    }
+    return last;
+}
+
+
+/* map an input timestamp to the repaired time line */
+static int64
+flv_ts_repair_timestamp(flv_ts_repair_t * repair, flv_ts_track_t * track, u_int timestamp)
+{
+    int64 in, delta, out;
+
+    if (!repair->started) {
+        repair->started = 1;
+        repair->base_offset = repair->zero_base ? -(int64) timestamp : 0;
+    }
+
+    if (track == &repair->tracks[FLV_TS_TRACK_SCRIPT]) {
+        /* script tags are sparse, they follow the audio / video correction */
+        in = (int64) timestamp + repair->tracks[FLV_TS_TRACK_VIDEO].epoch;
+        track->offset = (repair->generation > 0) ? repair->discontinuity_offset : repair->base_offset;
+        track->started = 1;
+    } else if (!track->started) {
+        track->started = 1;
+        track->offset = repair->base_offset;
+        track->generation = repair->generation;
+        in = timestamp;
+    } else {
+        in = (int64) timestamp + track->epoch;
+
+        /* encoders ignoring timestamp_ex wrap after 2^24 ms */
+        if (in < track->last_in && in + FLV_TS_REPAIR_WRAP - track->last_in <= (int64) repair->max_gap) {
+            track->epoch += FLV_TS_REPAIR_WRAP;
+            in += FLV_TS_REPAIR_WRAP;
+            ++(repair->wraps);
+        }
+
+        delta = in - track->last_in;
+        if (delta < 0 || delta > (int64) repair->max_gap) {
+            if (track->generation != repair->generation
+            &&  in - repair->discontinuity_in <= (int64) repair->max_gap
+            &&  repair->discontinuity_in - in <= (int64) repair->max_gap)
+            {
+                /* the other track already jumped there, share its correction */
+                track->offset = repair->discontinuity_offset;
+            } else {
+                track->offset = flv_ts_repair_last_out(repair) + track->duration - in;
+                ++(repair->generation);
+                repair->discontinuity_in = in;
+                repair->discontinuity_offset = track->offset;
+                ++(repair->discontinuities);
+            }
+            track->generation = repair->generation;
+        } else if (delta > 0 && track->duration > 0) {
+            track->duration = (u_int) ((track->duration * 7 + delta) / 8);
+            if (track->duration == 0) {
+                track->duration = 1;
+            }
+        }
+    }
+    track->last_in = in;
+
+    out = in + track->offset;
+    if (out < track->last_out) {
+        out = track->last_out;
+        ++(repair->clamped);
+    }
+    if (out < 0) {
+        out = 0;
+    }
+    track->last_out = out;
+    return out;
+}
+
+
+static flv_code
+flv_ts_repair_emit(flv_ts_repair_t * repair)
+{
+    flv_ts_slot_t * slot = repair->window[0];
+    int64 ts;
+    int e;
+
+    memmove(&repair->window[0], &repair->window[1], (repair->count - 1) * sizeof(flv_ts_slot_t *));
+    --(repair->count);
+    repair->window[repair->count] = slot;
+
+    /* keep the merged output monotonic across tracks */
+    ts = slot->timestamp;
+    if (ts < repair->last_emitted) {
+        ts = repair->last_emitted;
+        ++(repair->clamped);
+    }
+    repair->last_emitted = ts;
+    flv_tag_set_timestamp(&slot->tag, (u_int) ts);
+
+    if (repair->sink != NULL) {
+        e = repair->sink(&slot->tag, slot->body, repair->user_data);
+        if (e != FLV_OK) {
+            return (flv_code) e;
+        }
+    }
+    return FLV_OK;
+}
+
+
+flv_code
+flv_ts_repair_push(flv_ts_repair_t * repair, const flv_tag_header_t * tag, const void * body)
+{
+    flv_ts_slot_t * slot;
+    flv_ts_track_t * track;
+    u_int lookahead, i;
+    flv_code e;
+
+    /* a missing body would hand the sink the bytes of an earlier tag */
+    if (repair == NULL || tag == NULL || (body == NULL && tag->body_length > 0)) {
+        return FLV_ERROR_NULL_POINTER;
+    }
+
+    lookahead = repair->lookahead;
+    if (lookahead == 0 || lookahead > FLV_TS_REPAIR_MAX_LOOKAHEAD) {
+        lookahead = FLV_TS_REPAIR_MAX_LOOKAHEAD;
+    }
+    while (repair->count >= lookahead) {
+        if ((e = flv_ts_repair_emit(repair)) != FLV_OK) {
+            return e;
+        }
+    }
+
+    slot = repair->window[repair->count];
+    if (slot->capacity < tag->body_length) {
+        u_byte * buffer = (u_byte*) realloc(slot->body, tag->body_length);
+        if (buffer == NULL) {
+            std_log_error("alloc memory failed");
+            return FLV_ERROR_MEMORY;
+        }
+        slot->body = buffer;
+        slot->capacity = tag->body_length;
+    }
+    if (tag->body_length > 0) {
+        memcpy(slot->body, body, tag->body_length);
+    }
+
+    track = &repair->tracks[flv_ts_repair_track(tag->tag_type)];
+    memcpy(&slot->tag, tag, sizeof(flv_tag_header_t));
+    slot->timestamp = flv_ts_repair_timestamp(repair, track, flv_tag_get_timestamp(tag));
+
+    /* insertion into the sorted window, equal timestamps keep input order */
+    for (i = repair->count; i > 0 && repair->window[i-1]->timestamp > slot->timestamp; --i) {
+        repair->window[i] = repair->window[i-1];
+    }
+    repair->window[i] = slot;
+    ++(repair->count);
+
+    return FLV_OK;
+}
+
+
+flv_code
+flv_ts_repair_flush(flv_ts_repair_t * repair)
+{
+    flv_code e;
+
+    if (repair == NULL) {
+        return FLV_ERROR_NULL_POINTER;
+    }
+
+    while (repair->count > 0) {
+        if ((e = flv_ts_repair_emit(repair)) != FLV_OK) {
+            return e;
+        }
+    }
+    return FLV_OK;
+}
+
+
+void
+flv_ts_repair_free(flv_ts_repair_t * repair)
+{
+    u_int i;
+
+    if (repair != NULL) {
+        for (i = 0; i < FLV_TS_REPAIR_MAX_LOOKAHEAD; ++i) {
+            free(repair->slots[i].body);
+            repair->slots[i].body = NULL;
+            repair->slots[i].capacity = 0;
+        }
+        repair->count = 0;
+    }
+}
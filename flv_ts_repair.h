@@ -0,0 +1,102 @@
+#ifndef __FLV_TS_REPAIR_H__
+#define __FLV_TS_REPAIR_H__
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "std_log.h"
+#include "util.h"
+#include "flv.h"
+
+
+
+
+/*
+ * Streaming timestamp repair stage.
+ *
+ * Tags are pushed in file order and handed to the sink with a repaired timestamp:
+ * 24 bits wraparound is unwrapped, backward jumps and forward jumps above max_gap
+ * are re-based right after the last repaired timestamp, audio and video hitting the
+ * same discontinuity share one correction so they stay aligned. A small lookahead
+ * window reorders the output, which is monotonic over all tracks. Tag bodies are
+ * copied into reused slot buffers, the body handed to the sink is only valid
+ * during the call.
+ */
+
+#define FLV_TS_REPAIR_MAX_LOOKAHEAD         64
+#define FLV_TS_REPAIR_DEFAULT_LOOKAHEAD     16
+#define FLV_TS_REPAIR_DEFAULT_MAX_GAP       1000u       // ms
+#define FLV_TS_REPAIR_WRAP                  0x1000000u  // 24 bits timestamp range
+
+#define FLV_TS_REPAIR_DEFAULT_AUDIO_DURATION    23u     // ms, 1024 samples at 44.1 kHz
+#define FLV_TS_REPAIR_DEFAULT_VIDEO_DURATION    40u     // ms, 25 fps
+
+#define FLV_TS_TRACK_AUDIO      0
+#define FLV_TS_TRACK_VIDEO      1
+#define FLV_TS_TRACK_SCRIPT     2
+#define FLV_TS_TRACKS           3
+
+typedef struct flv_ts_track_s {
+    u_byte      started;
+    int64       epoch;          // wraparound correction added to the input timestamp
+    int64       offset;         // discontinuity correction added to the unwrapped timestamp
+    int64       last_in;        // last unwrapped input timestamp
+    int64       last_out;       // last repaired timestamp
+    u_int       duration;       // estimated tag duration, in ms
+    u_int       generation;     // last shared discontinuity applied to this track
+} flv_ts_track_t;
+
+typedef struct flv_ts_slot_s {
+    flv_tag_header_t    tag;
+    int64               timestamp;  // repaired timestamp
+    u_byte             *body;
+    u_int               capacity;   // body buffer size, buffers are reused
+} flv_ts_slot_t;
+
+typedef struct flv_ts_repair_s {
+    /* configuration, may be changed after flv_ts_repair_init() */
+    u_int               max_gap;        // ms, larger forward jumps are discontinuities
+    u_int               lookahead;      // tags held back, at most FLV_TS_REPAIR_MAX_LOOKAHEAD
+    u_byte              zero_base;      // shift the first timestamp to 0
+
+    flv_tag_proc        sink;
+    void               *user_data;
+
+    flv_ts_track_t      tracks[FLV_TS_TRACKS];
+    u_byte              started;
+    int64               base_offset;
+
+    /* last discontinuity, shared between tracks */
+    u_int               generation;
+    int64               discontinuity_in;
+    int64               discontinuity_offset;
+
+    /* lookahead window, sorted by repaired timestamp */
+    u_int               count;
+    int64               last_emitted;
+    flv_ts_slot_t      *window[FLV_TS_REPAIR_MAX_LOOKAHEAD];
+    flv_ts_slot_t       slots[FLV_TS_REPAIR_MAX_LOOKAHEAD];
+
+    /* counters */
+    u_int64             wraps;
+    u_int64             discontinuities;
+    u_int64             clamped;
+} flv_ts_repair_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+void        flv_ts_repair_init(flv_ts_repair_t * repair, flv_tag_proc sink, void * user_data);
+/* body holds the body_length bytes of the tag, FLV_ERROR_NULL_POINTER if it is missing */
+flv_code    flv_ts_repair_push(flv_ts_repair_t * repair, const flv_tag_header_t * tag, const void * body);
+flv_code    flv_ts_repair_flush(flv_ts_repair_t * repair);
+void        flv_ts_repair_free(flv_ts_repair_t * repair);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FLV_TS_REPAIR_H__ */
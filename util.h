@@ -19,6 +19,7 @@ typedef char flv_code;  /* use char for type byte haven't been defined */
 #define FLV_ERROR_EMPTY_TAG             7
 #define FLV_ERROR_INVALID_METADATA_NAME 8
 #define FLV_ERROR_INVALID_METADATA      9
+#define FLV_ERROR_NULL_POINTER          10
 
 
 
@@ -44,6 +45,20 @@ typedef char                byte;
 
 #define u_int24_be2u_int32(val) (((val & 0x0000ff) << 16) | ((val & 0xff0000) >> 16))
 
+/* big-endian loads and stores from unaligned byte buffers */
+#define load_u_int16_be(p)  ((u_short) ((((const u_byte*)(p))[0] << 8) | ((const u_byte*)(p))[1]))
+#define load_u_int24_be(p)  (((u_int) ((const u_byte*)(p))[0] << 16) | ((u_int) ((const u_byte*)(p))[1] << 8) \
+                        |   ((u_int) ((const u_byte*)(p))[2]))
+#define load_u_int32_be(p)  (((u_int) ((const u_byte*)(p))[0] << 24) | ((u_int) ((const u_byte*)(p))[1] << 16) \
+                        |   ((u_int) ((const u_byte*)(p))[2] <<  8) | ((u_int) ((const u_byte*)(p))[3]))
+#define load_u_int64_be(p)  (((u_int64) load_u_int32_be(p) << 32) | (u_int64) load_u_int32_be((const u_byte*)(p) + 4))
+
+#define store_u_int16_be(p, val)    do { ((u_byte*)(p))[0] = (u_byte) ((val) >>  8); ((u_byte*)(p))[1] = (u_byte) (val); } while (0)
+#define store_u_int24_be(p, val)    do { ((u_byte*)(p))[0] = (u_byte) ((val) >> 16); ((u_byte*)(p))[1] = (u_byte) ((val) >> 8); \
+                                         ((u_byte*)(p))[2] = (u_byte) (val); } while (0)
+#define store_u_int32_be(p, val)    do { ((u_byte*)(p))[0] = (u_byte) ((val) >> 24); ((u_byte*)(p))[1] = (u_byte) ((val) >> 16); \
+                                         ((u_byte*)(p))[2] = (u_byte) ((val) >>  8); ((u_byte*)(p))[3] = (u_byte) (val); } while (0)
+
 
 
 